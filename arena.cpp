@@ -0,0 +1,214 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+// frame-scoped bump allocation:
+//
+//	an Arena hands out memory by moving a pointer along one big block, and gives it all back
+//	at once with ArenaReset( ) -- no per-allocation bookkeeping and nothing to free one by one
+//	ArenaMark( ) / ArenaRelease( ) give back everything allocated since the mark, for scratch
+//	memory that is only needed inside one call
+//	when the block runs out, the request is malloc'ed instead and freed at the release or reset
+//	that gives it back, and the block is regrown at the reset to cover the most that was live at
+//	once, so it settles quickly
+//
+//	every thread of a job system has an arena of its own (jobs.cpp, which comes after this, sets
+//	JobThreadIndex to pick it); the frame arenas are those of the render job system, and
+//	Display( ) resets them all at the top of each frame, when no jobs are running
+//	only the main thread and its job workers may call FrameAlloc( ) -- the simulation thread
+//	would share the main thread's arena
+//	the blocks and spills are counted in MEM_SCRATCH (so this comes after memtrack.cpp)
+
+#define ARENA_ALIGN			16
+#define ARENA_GRANULE		(64*1024)		// blocks grow in steps of this many bytes
+
+struct Arena
+{
+	char *		base;
+	size_t		size;				// bytes at base
+	size_t		used;				// bytes handed out from base and not yet given back
+	size_t		spilled;			// bytes in spill blocks not yet given back
+	size_t		high;				// the most of used + spilled since the last reset
+	std::vector<void *>	spill;		// blocks malloc'ed when base ran out, oldest first
+};
+
+struct ArenaMarker
+{
+	size_t		used, spilled;
+	size_t		numSpills;
+};
+
+static thread_local int JobThreadIndex = 0;		// which of its job system's threads this is
+
+
+void
+ArenaInit( struct Arena *a, size_t bytes )
+{
+	a->size = ( bytes + ARENA_GRANULE - 1 ) / ARENA_GRANULE * ARENA_GRANULE;
+	a->base = a->size > 0 ? (char *)malloc( a->size ) : NULL;
+	if( a->base == NULL )
+		a->size = 0;
+	MemAdd( MEM_SCRATCH, a->size );
+	a->used = 0;
+	a->spilled = 0;
+	a->high = 0;
+	a->spill.clear( );
+}
+
+
+void *
+ArenaAlloc( struct Arena *a, size_t bytes )
+{
+	bytes = ( bytes + ARENA_ALIGN - 1 ) & ~(size_t)( ARENA_ALIGN - 1 );
+	void *p;
+	if( a->used + bytes <= a->size )
+	{
+		p = a->base + a->used;
+		a->used += bytes;
+	}
+	else
+	{
+		p = malloc( bytes );
+		if( p == NULL )
+		{
+			fprintf( stderr, "Arena: out of memory allocating %lu bytes\n", (unsigned long)bytes );
+			exit( 1 );
+		}
+		a->spill.push_back( p );
+		a->spilled += bytes;
+		MemAdd( MEM_SCRATCH, bytes );
+	}
+	if( a->used + a->spilled > a->high )
+		a->high = a->used + a->spilled;
+	return p;
+}
+
+
+inline
+struct ArenaMarker
+ArenaMark( struct Arena *a )
+{
+	struct ArenaMarker m = { a->used, a->spilled, a->spill.size( ) };
+	return m;
+}
+
+
+// give back everything allocated since the mark, spill blocks included:
+
+inline
+void
+ArenaRelease( struct Arena *a, struct ArenaMarker mark )
+{
+	if( mark.used <= a->used )
+		a->used = mark.used;
+	if( mark.numSpills < a->spill.size( ) )
+	{
+		for( size_t i = mark.numSpills; i < a->spill.size( ); i++ )
+			free( a->spill[i] );
+		a->spill.resize( mark.numSpills );
+		MemSub( MEM_SCRATCH, a->spilled - mark.spilled );
+		a->spilled = mark.spilled;
+	}
+}
+
+
+// give everything back, returning the most that was in use at once since the last reset:
+
+size_t
+ArenaReset( struct Arena *a )
+{
+	for( unsigned int i = 0; i < a->spill.size( ); i++ )
+		free( a->spill[i] );
+	a->spill.clear( );
+	MemSub( MEM_SCRATCH, a->spilled );
+
+	size_t high = a->high;
+	if( high > a->size )
+	{
+		// nothing in the old block is live any more, so there's nothing to copy:
+		free( a->base );
+		MemSub( MEM_SCRATCH, a->size );
+		ArenaInit( a, high );
+	}
+	a->used = 0;
+	a->spilled = 0;
+	a->high = 0;
+	return high;
+}
+
+
+void
+ArenaFree( struct Arena *a )
+{
+	ArenaReset( a );
+	free( a->base );
+	MemSub( MEM_SCRATCH, a->size );
+	a->base = NULL;
+	a->size = 0;
+}
+
+
+// the per-thread frame arenas:
+
+struct Arena *	FrameArenas;
+int				NumFrameArenas;
+size_t			FrameArenaLast;			// bytes the last frame used, all threads together
+size_t			FrameArenaPeak;			// the most any frame has used
+
+
+// use a job system's arenas, one per thread, as the frame arenas, growing them to bytesEach --
+// call after JobsStart( ), and FrameArenasFree( ) before JobsStop( ), which frees them:
+
+void
+FrameArenasInit( struct Arena *arenas, int numThreads, size_t bytesEach )
+{
+	FrameArenas = arenas;
+	NumFrameArenas = numThreads;
+	for( int i = 0; i < numThreads; i++ )
+	{
+		ArenaFree( &FrameArenas[i] );
+		ArenaInit( &FrameArenas[i], bytesEach );
+	}
+	FrameArenaLast = 0;
+	FrameArenaPeak = 0;
+}
+
+
+void
+FrameArenasFree( )
+{
+	FrameArenas = NULL;
+	NumFrameArenas = 0;
+}
+
+
+// start a new frame: everything FrameAlloc( )'ed last frame is gone after this
+
+void
+FrameArenasReset( )
+{
+	size_t frame = 0;
+	for( int i = 0; i < NumFrameArenas; i++ )
+		frame += ArenaReset( &FrameArenas[i] );
+	FrameArenaLast = frame;
+	if( frame > FrameArenaPeak )
+		FrameArenaPeak = frame;
+}
+
+
+inline
+struct Arena *
+FrameArena( )
+{
+	return &FrameArenas[ JobThreadIndex ];
+}
+
+
+// memory that lasts until the start of the next frame:
+
+inline
+void *
+FrameAlloc( size_t bytes )
+{
+	return ArenaAlloc( FrameArena( ), bytes );
+}
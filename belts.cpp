@@ -0,0 +1,349 @@
+#include <stdio.h>
+#include <math.h>
+#include <thread>
+#include <chrono>
+
+// asteroid and kuiper belt particle systems:
+//
+//	each belt holds 100k-1M bodies as structure-of-arrays orbital elements (float is plenty
+//	for points), advanced along their orbits by BeltUpdate( ), which hands the clusters
+//	(below) to the job system as a parallel-for
+//	the orientation of each orbit never changes, so it is kept as the two unit vectors P (toward
+//	perihelion) and Q (90 degrees ahead) and the update only has to solve kepler's equation
+//	positions come out heliocentric, in AU, as x/y/z arrays (so the kernel vectorizes) and are then
+//	interleaved for glDrawArrays( GL_POINTS )
+//	bodies are kept in runs of BELT_CLUSTER, each starting out in one sector of longitude, and the
+//	update also finds each run's bounding sphere, so a run can be culled or picked as one object
+
+#define DEFAULT_BELT_BODIES		200000
+#define BELT_CLUSTER			4096
+#define GAUSS_DEG_PER_DAY		0.9856076686f	// mean motion at 1 AU
+
+struct ParticleBelt
+{
+	int		n;
+	float	*a, *b, *e;						// semi-major and semi-minor axes (AU), eccentricity
+	float	*M0, *motion;					// mean anomaly at J2000 (radians), mean motion (radians/day)
+	float	*Px, *Py, *Pz, *Qx, *Qy, *Qz;	// orbit orientation in ecliptic coordinates
+	float	*x, *y, *z;						// position in AU, ecliptic coordinates
+	float	*xyz;							// the same, interleaved for drawing
+	int		numClusters;					// bodies [c*BELT_CLUSTER, (c+1)*BELT_CLUSTER) are cluster c
+	float	(*clusterCenter)[3];			// each cluster's bounding sphere, AU, ecliptic coordinates
+	float	*clusterRadius;
+	GLuint	vbo;							// streamed vertex buffer, 0 if not created yet
+	float	color[3];
+};
+
+// branch-free sine and cosine for the belt kernel, good to about 4e-6:
+// libm's sinf( ) and cosf( ) of the same angle get merged into one sincosf( ) call, which
+// compilers won't vectorize -- these inline polynomials vectorize everywhere
+
+inline
+float
+BeltSin( float x )
+{
+	const float pi = (float)M_PI;
+	const float halfpi = (float)M_PI_2;
+	// the nearest whole turn: floorf( ) and rintf( ) are calls on plain sse2, and the old trick
+	// of adding and subtracting 1.5 * 2^23 is folded away by -ffast-math, but a float to int
+	// conversion (which truncates) is one vector instruction and can't be reassociated:
+	float t = x * ( 0.5f / pi );
+	float k = (float)(int)( t + copysignf( 0.5f, t ) );
+	x -= 2.f * pi * k;										// [-pi,pi]
+	float y = halfpi - fabsf( halfpi - fabsf( x ) );		// [0,pi/2], same sine as |x|
+	float y2 = y * y;
+	float s = y * ( 1.f + y2 * ( -1.f/6.f + y2 * ( 1.f/120.f + y2 * ( -1.f/5040.f + y2 * ( 1.f/362880.f ) ) ) ) );
+	return copysignf( s, x );								// no selects, so the loop has no control flow
+}
+
+inline
+float
+BeltCos( float x )
+{
+	return BeltSin( x + (float)M_PI_2 );
+}
+
+
+// small deterministic generator so the belts look the same every run, on every platform:
+
+static unsigned int BeltRandomState = 12345;
+
+inline
+float
+BeltRandom( float lo, float hi )
+{
+	BeltRandomState ^= BeltRandomState << 13;
+	BeltRandomState ^= BeltRandomState >> 17;
+	BeltRandomState ^= BeltRandomState << 5;
+	return lo + ( hi - lo ) * (float)( BeltRandomState & 0xffffff ) / (float)0x1000000;
+}
+
+
+// fill a belt with n bodies with semi-major axes in [amin,amax):
+// the longitudes `days' after J2000 go up with the body number, so each cluster starts as a
+// narrow wedge of the belt (they shear apart as the orbits advance, but only over years)
+
+void
+InitBelt( struct ParticleBelt *belt, int n, float amin, float amax, float emax, float incmaxdeg, double days, float r, float g, float b )
+{
+	belt->n = n;
+	belt->a      = new float[ n ];
+	belt->b      = new float[ n ];
+	belt->e      = new float[ n ];
+	belt->M0     = new float[ n ];
+	belt->motion = new float[ n ];
+	belt->Px = new float[ n ];	belt->Py = new float[ n ];	belt->Pz = new float[ n ];
+	belt->Qx = new float[ n ];	belt->Qy = new float[ n ];	belt->Qz = new float[ n ];
+	belt->x = new float[ n ];	belt->y = new float[ n ];	belt->z = new float[ n ];
+	belt->xyz    = new float[ 3 * n ];
+	belt->numClusters   = ( n + BELT_CLUSTER - 1 ) / BELT_CLUSTER;
+	belt->clusterCenter = new float[ belt->numClusters ][3];
+	belt->clusterRadius = new float[ belt->numClusters ];
+	belt->vbo    = 0;
+	MemAdd( MEM_MESHES, ( 18 * n + 4 * belt->numClusters ) * sizeof(float) );
+	belt->color[0] = r;	belt->color[1] = g;	belt->color[2] = b;
+
+	const float twopi = 2.f * (float)M_PI;
+	for( int i = 0; i < n; i++ )
+	{
+		float a    = BeltRandom( amin, amax );
+		float e    = BeltRandom( 0.f, emax );
+		float inc  = BeltRandom( 0.f, 1.f ) * BeltRandom( 0.f, 1.f ) * incmaxdeg * (float)M_PI / 180.f;	// favor low inclinations
+		float node = BeltRandom( 0.f, twopi );
+		float w    = BeltRandom( 0.f, twopi );
+		belt->a[i]      = a;
+		belt->b[i]      = a * sqrtf( 1.f - e*e );
+		belt->e[i]      = e;
+		belt->motion[i] = GAUSS_DEG_PER_DAY * (float)M_PI / 180.f / ( a * sqrtf( a ) );
+
+		// put the body at longitude lambda (node + w + true anomaly, near enough at these
+		// inclinations) on that date, going through the eccentric anomaly to the mean anomaly:
+		float lambda = twopi * ( (float)i + BeltRandom( 0.f, 1.f ) ) / (float)n;
+		float nu = lambda - node - w;
+		float E = 2.f * atan2f( sqrtf( 1.f - e ) * sinf( nu / 2.f ), sqrtf( 1.f + e ) * cosf( nu / 2.f ) );
+		float M = E - e * sinf( E );
+		belt->M0[i] = (float)fmod( M - belt->motion[i] * days, 2. * M_PI );
+
+		float cw = cosf( w ),		sw = sinf( w );
+		float cn = cosf( node ),	sn = sinf( node );
+		float ci = cosf( inc ),		si = sinf( inc );
+		belt->Px[i] =  cw*cn - sw*sn*ci;	belt->Py[i] =  cw*sn + sw*cn*ci;	belt->Pz[i] = sw*si;
+		belt->Qx[i] = -sw*cn - cw*sn*ci;	belt->Qy[i] = -sw*sn + cw*cn*ci;	belt->Qz[i] = cw*si;
+	}
+}
+
+
+// solve kepler's equation and place n bodies at `t' days since J2000:
+// the pointers are parameters rather than locals because compilers only trust __restrict
+// on parameters, and without it the loop needs too many alias checks to vectorize
+
+void
+BeltKernel( int n, float t, const float * __restrict a, const float * __restrict b, const float * __restrict ec,
+	const float * __restrict M0, const float * __restrict mm,
+	const float * __restrict Px, const float * __restrict Py, const float * __restrict Pz,
+	const float * __restrict Qx, const float * __restrict Qy, const float * __restrict Qz,
+	float * __restrict x, float * __restrict y, float * __restrict z )
+{
+	for( int i = 0; i < n; i++ )
+	{
+		float M = M0[i] + mm[i] * t;		// BeltSin( ) does the range reduction
+
+		float e = ec[i];
+		float E = M + e * BeltSin( M );
+		E -= ( E - e * BeltSin( E ) - M ) / ( 1.f - e * BeltCos( E ) );		// three newton steps, written out
+		E -= ( E - e * BeltSin( E ) - M ) / ( 1.f - e * BeltCos( E ) );		// so the loop stays vectorizable
+		E -= ( E - e * BeltSin( E ) - M ) / ( 1.f - e * BeltCos( E ) );
+
+		float xp = a[i] * ( BeltCos( E ) - e );
+		float yp = b[i] * BeltSin( E );
+
+		x[i] = Px[i] * xp + Qx[i] * yp;
+		y[i] = Py[i] * xp + Qy[i] * yp;
+		z[i] = Pz[i] * xp + Qz[i] * yp;
+	}
+}
+
+
+// advance bodies [first,last) to `days' since J2000, and bound the clusters that start in the range:
+// first must be a multiple of BELT_CLUSTER
+
+void
+BeltUpdateRange( struct ParticleBelt *belt, double days, int first, int last )
+{
+	// a float mean anomaly a few hundred radians out still has ~1e-4 radian precision,
+	// plenty for a point -- and keeping the loop all-float lets it vectorize:
+
+	int i = first;
+	BeltKernel( last - first, (float)days, belt->a + i, belt->b + i, belt->e + i, belt->M0 + i, belt->motion + i,
+		belt->Px + i, belt->Py + i, belt->Pz + i, belt->Qx + i, belt->Qy + i, belt->Qz + i,
+		belt->x + i, belt->y + i, belt->z + i );
+
+	const float *x = belt->x, *y = belt->y, *z = belt->z;
+	float *xyz = belt->xyz;
+	for( i = first; i < last; i++ )
+	{
+		xyz[3*i+0] = x[i];
+		xyz[3*i+1] = y[i];
+		xyz[3*i+2] = z[i];
+	}
+
+	for( int c = first / BELT_CLUSTER; c * BELT_CLUSTER < last; c++ )
+	{
+		int c0 = c * BELT_CLUSTER;
+		int c1 = c0 + BELT_CLUSTER < belt->n ? c0 + BELT_CLUSTER : belt->n;
+		float lo[3] = { x[c0], y[c0], z[c0] };
+		float hi[3] = { x[c0], y[c0], z[c0] };
+		for( i = c0 + 1; i < c1; i++ )
+		{
+			lo[0] = fminf( lo[0], x[i] );	hi[0] = fmaxf( hi[0], x[i] );
+			lo[1] = fminf( lo[1], y[i] );	hi[1] = fmaxf( hi[1], y[i] );
+			lo[2] = fminf( lo[2], z[i] );	hi[2] = fmaxf( hi[2], z[i] );
+		}
+		float *center = belt->clusterCenter[c];
+		for( int k = 0; k < 3; k++ )
+			center[k] = .5f * ( lo[k] + hi[k] );
+		float dx = hi[0] - center[0], dy = hi[1] - center[1], dz = hi[2] - center[2];
+		belt->clusterRadius[c] = sqrtf( dx*dx + dy*dy + dz*dz );	// the box's corner, so it holds every body
+	}
+}
+
+
+// advance every body in a belt, a few clusters per job:
+
+struct BeltUpdateArgs
+{
+	struct ParticleBelt	*belt;
+	double				days;
+};
+
+static void
+BeltUpdateClusters( void *data, int firstCluster, int lastCluster )
+{
+	struct BeltUpdateArgs *args = (struct BeltUpdateArgs *)data;
+	int last = lastCluster * BELT_CLUSTER;
+	BeltUpdateRange( args->belt, args->days, firstCluster * BELT_CLUSTER, last < args->belt->n ? last : args->belt->n );
+}
+
+void
+BeltUpdate( struct ParticleBelt *belt, double days, struct JobSystem *js )
+{
+	struct BeltUpdateArgs args = { belt, days };
+	ParallelFor( js, belt->numClusters, 1, BeltUpdateClusters, &args );
+}
+
+
+// draw a belt as points, only the clusters with visible[c] != 0 (all of them if visible is NULL),
+// returning how many bodies that was:
+// the caller has translated to the sun and scaled AU to scene units;
+// ecliptic (x,y,z) becomes scene (x,z,-y) so the ecliptic lies in the scene's x-z plane
+
+int
+DrawBelt( struct ParticleBelt *belt, const unsigned char *visible )
+{
+	static const GLfloat eclipticToScene[16] =
+	{
+		1.,  0., 0., 0.,
+		0.,  0., -1., 0.,
+		0.,  1., 0., 0.,
+		0.,  0., 0., 1.
+	};
+
+	glPushMatrix( );
+	glMultMatrixf( eclipticToScene );
+	glPushAttrib( GL_ENABLE_BIT | GL_POINT_BIT );
+	glDisable( GL_LIGHTING );
+	glDisable( GL_TEXTURE_2D );
+	glPointSize( 1. );
+	glColor3fv( belt->color );
+
+	glPushClientAttrib( GL_CLIENT_VERTEX_ARRAY_BIT );
+	glEnableClientState( GL_VERTEX_ARRAY );
+	if( GLEW_VERSION_1_5 )
+	{
+		// orphan and refill the buffer so we never wait on the previous frame's draw:
+		if( belt->vbo == 0 )
+		{
+			glGenBuffers( 1, &belt->vbo );
+			MemAdd( MEM_BUFFERS_GPU, 3 * belt->n * sizeof(float) );
+		}
+		glBindBuffer( GL_ARRAY_BUFFER, belt->vbo );
+		glBufferData( GL_ARRAY_BUFFER, 3 * belt->n * sizeof(float), NULL, GL_STREAM_DRAW );
+		glBufferSubData( GL_ARRAY_BUFFER, 0, 3 * belt->n * sizeof(float), belt->xyz );
+		glVertexPointer( 3, GL_FLOAT, 0, (void *)0 );
+	}
+	else
+	{
+		glVertexPointer( 3, GL_FLOAT, 0, belt->xyz );
+	}
+
+	// one draw per run of neighboring visible clusters:
+	int drawn = 0;
+	for( int c = 0; c < belt->numClusters; )
+	{
+		if( visible != NULL  &&  ! visible[c] )
+		{
+			c++;
+			continue;
+		}
+		int c0 = c;
+		while( c < belt->numClusters  &&  ( visible == NULL  ||  visible[c] ) )
+			c++;
+		int first = c0 * BELT_CLUSTER;
+		int last  = c * BELT_CLUSTER < belt->n ? c * BELT_CLUSTER : belt->n;
+		glDrawArrays( GL_POINTS, first, last - first );
+		drawn += last - first;
+	}
+	if( GLEW_VERSION_1_5 )
+		glBindBuffer( GL_ARRAY_BUFFER, 0 );
+	glPopClientAttrib( );
+
+	glPopAttrib( );
+	glPopMatrix( );
+	return drawn;
+}
+
+
+// time BeltUpdate( ) with a job system of 1, 2, 4, ... threads and print bodies/ms for each:
+// the single-thread run, which is all on this thread, is also measured with the performance counters
+// run with -beltbench, no window needed
+
+void
+BeltBenchmark( struct ParticleBelt *belt, FILE *fp )
+{
+	int maxThreads = (int)std::thread::hardware_concurrency( );
+	if( maxThreads < 1 )
+		maxThreads = 1;
+
+	PerfStart( );
+	fprintf( fp, "{\n  \"bodies\": %d,\n  \"results\": [\n", belt->n );
+	for( int threads = 1; ; threads *= 2 )
+	{
+		if( threads > maxThreads )
+			threads = maxThreads;
+
+		struct JobSystem js;
+		JobsStart( &js, threads );
+		const int reps = 10;
+		BeltUpdate( belt, 0., &js );		// warm up
+		if( threads == 1 )
+			PerfBegin( PERF_PHASE_BELT_UPDATE );
+		std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now( );
+		for( int r = 0; r < reps; r++ )
+			BeltUpdate( belt, 10. * r, &js );
+		double ms = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now( ) - t0 ).count( ) / reps;
+		if( threads == 1 )
+			PerfEnd( PERF_PHASE_BELT_UPDATE, (long long)belt->n * reps );
+		JobsStop( &js );
+
+		fprintf( fp, "    { \"threads\": %d, \"ms_per_update\": %.3f, \"bodies_per_ms\": %.0f }%s\n",
+			threads, ms, (double)belt->n / ms, threads == maxThreads ? "" : "," );
+		if( threads == maxThreads )
+			break;
+	}
+	fprintf( fp, "  ],\n" );
+	PerfReportJson( fp, "  " );
+	fprintf( fp, ",\n" );
+	MemReportJson( fp, "  " );
+	fprintf( fp, "\n}\n" );
+	PerfStop( );
+}
@@ -0,0 +1,170 @@
+#include <stdio.h>
+#include <string.h>
+
+// structure-of-arrays store for the sun, planets and moons:
+//
+//	each property of every body is its own contiguous array, so a pass that only needs
+//	positions and radii (placing, culling, drawing) streams through just those arrays
+//	the scaled values the renderer wants are derived, and BodyStoreRefresh( ) only
+//	recomputes them for bodies whose inputs changed -- or for all of them when the
+//	distance or radius scale itself changes -- so nothing is divided per body per frame
+//	change positions and radii through the setters so the dirty flags stay right
+
+#define BODY_DIRTY_POSITION		1
+#define BODY_DIRTY_RADIUS		2
+
+struct BodyStore
+{
+	int		n, capacity;
+
+	// inputs:
+	const char	**name;
+	int		*kind;					// BODY_STAR or BODY_PLANET
+	int		*parent;				// index of the parent body, -1 for a root
+	double	*x, *y, *z;				// world position, miles
+	double	*distance;				// from the parent, miles
+	double	*routeDistance;			// where along the tour route it sits: distance, or its true distance with -date
+	double	*offsetY, *offsetZ;		// miles off the route
+	float	*radius;				// miles
+	float	*rotate;				// degrees about y
+	GLuint	*texture;
+	int		*slices, *stacks;		// sphere level of detail
+	int		*ephemerisIndex;		// slot in the ephemeris, -1 if it has no orbit
+
+	// derived, kept current by BodyStoreRefresh( ):
+	double	*sx, *sy, *sz;			// world position / distance scale
+	float	*radiusScaled;			// radius / radius scale
+	unsigned char	*dirty;			// BODY_DIRTY_* bits
+	double	distanceScale;			// the scales the derived values were computed with
+	double	radiusScale;
+};
+
+
+template <class T>
+static void
+GrowArray( T **array, int n, int oldCapacity, int capacity )
+{
+	MemAdd( MEM_OTHER, ( capacity - oldCapacity ) * (long long)sizeof(T) );
+	T *grown = new T[ capacity ];
+	for( int i = 0; i < n; i++ )
+		grown[i] = (*array)[i];
+	delete [ ] *array;
+	*array = grown;
+}
+
+
+// make room for at least n bodies:
+
+void
+BodyStoreReserve( struct BodyStore *bs, int n )
+{
+	if( n <= bs->capacity )
+		return;
+
+	int capacity = bs->capacity == 0 ? 16 : bs->capacity;
+	while( capacity < n )
+		capacity *= 2;
+
+	GrowArray( &bs->name, bs->n, bs->capacity, capacity );
+	GrowArray( &bs->kind, bs->n, bs->capacity, capacity );
+	GrowArray( &bs->parent, bs->n, bs->capacity, capacity );
+	GrowArray( &bs->x, bs->n, bs->capacity, capacity );
+	GrowArray( &bs->y, bs->n, bs->capacity, capacity );
+	GrowArray( &bs->z, bs->n, bs->capacity, capacity );
+	GrowArray( &bs->distance, bs->n, bs->capacity, capacity );
+	GrowArray( &bs->routeDistance, bs->n, bs->capacity, capacity );
+	GrowArray( &bs->offsetY, bs->n, bs->capacity, capacity );
+	GrowArray( &bs->offsetZ, bs->n, bs->capacity, capacity );
+	GrowArray( &bs->radius, bs->n, bs->capacity, capacity );
+	GrowArray( &bs->rotate, bs->n, bs->capacity, capacity );
+	GrowArray( &bs->texture, bs->n, bs->capacity, capacity );
+	GrowArray( &bs->slices, bs->n, bs->capacity, capacity );
+	GrowArray( &bs->stacks, bs->n, bs->capacity, capacity );
+	GrowArray( &bs->ephemerisIndex, bs->n, bs->capacity, capacity );
+	GrowArray( &bs->sx, bs->n, bs->capacity, capacity );
+	GrowArray( &bs->sy, bs->n, bs->capacity, capacity );
+	GrowArray( &bs->sz, bs->n, bs->capacity, capacity );
+	GrowArray( &bs->radiusScaled, bs->n, bs->capacity, capacity );
+	GrowArray( &bs->dirty, bs->n, bs->capacity, capacity );
+	bs->capacity = capacity;
+}
+
+
+// add a body with everything zeroed, returning its index:
+
+int
+BodyStoreAdd( struct BodyStore *bs, const char *name )
+{
+	BodyStoreReserve( bs, bs->n + 1 );
+	int i = bs->n++;
+	bs->name[i] = name;
+	bs->kind[i] = 0;
+	bs->parent[i] = -1;
+	bs->x[i] = bs->y[i] = bs->z[i] = 0.;
+	bs->distance[i] = bs->routeDistance[i] = 0.;
+	bs->offsetY[i] = bs->offsetZ[i] = 0.;
+	bs->radius[i] = 0.f;
+	bs->rotate[i] = 0.f;
+	bs->texture[i] = 0;
+	bs->slices[i] = bs->stacks[i] = 30;
+	bs->ephemerisIndex[i] = -1;
+	bs->dirty[i] = BODY_DIRTY_POSITION | BODY_DIRTY_RADIUS;
+	return i;
+}
+
+
+inline
+void
+BodyStoreSetPosition( struct BodyStore *bs, int i, double x, double y, double z )
+{
+	if( bs->x[i] != x  ||  bs->y[i] != y  ||  bs->z[i] != z )
+	{
+		bs->x[i] = x;
+		bs->y[i] = y;
+		bs->z[i] = z;
+		bs->dirty[i] |= BODY_DIRTY_POSITION;
+	}
+}
+
+
+inline
+void
+BodyStoreSetRadius( struct BodyStore *bs, int i, float radius )
+{
+	if( bs->radius[i] != radius )
+	{
+		bs->radius[i] = radius;
+		bs->dirty[i] |= BODY_DIRTY_RADIUS;
+	}
+}
+
+
+// bring the derived values up to date for these scales:
+
+void
+BodyStoreRefresh( struct BodyStore *bs, double distanceScale, double radiusScale )
+{
+	unsigned char all = 0;
+	if( distanceScale != bs->distanceScale )
+		all |= BODY_DIRTY_POSITION;
+	if( radiusScale != bs->radiusScale )
+		all |= BODY_DIRTY_RADIUS;
+	bs->distanceScale = distanceScale;
+	bs->radiusScale = radiusScale;
+
+	const double invDistance = 1. / distanceScale;
+	const double invRadius = 1. / radiusScale;
+	for( int i = 0; i < bs->n; i++ )
+	{
+		unsigned char d = bs->dirty[i] | all;
+		if( d & BODY_DIRTY_POSITION )
+		{
+			bs->sx[i] = bs->x[i] * invDistance;
+			bs->sy[i] = bs->y[i] * invDistance;
+			bs->sz[i] = bs->z[i] * invDistance;
+		}
+		if( d & BODY_DIRTY_RADIUS )
+			bs->radiusScaled[i] = (float)( bs->radius[i] * invRadius );
+		bs->dirty[i] = 0;
+	}
+}
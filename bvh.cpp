@@ -0,0 +1,377 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+// bounding-volume hierarchy over spheres:
+//
+//	the caller numbers its objects 0..n-1 and gives each a bounding sphere
+//	BvhBuild( ) sorts them into a binary tree of axis-aligned boxes (median split on the
+//	longest axis, a few objects per leaf); when the objects move, BvhRefit( ) keeps the tree
+//	and just recomputes the boxes bottom-up, which is O(n) and much cheaper than a rebuild
+//	queries walk the tree and skip whole subtrees, so they cost about log n plus the answer:
+//		BvhQueryFrustum( )	objects that may be in view
+//		BvhQueryRay( )		the closest object a ray hits (mouse picking)
+//		BvhQueryRadius( )	objects within some distance of a point
+
+#define BVH_LEAF_SIZE		4
+#define BVH_STACK			64			// deepest tree the queries can walk; a build splits by halves, so < 33
+
+struct BvhNode
+{
+	double	min[3], max[3];
+	int		left, right;			// children, for an inner node
+	int		first, count;			// range of items[ ], count > 0 for a leaf
+};
+
+struct Bvh
+{
+	int		numObjects;
+	double	(*center)[3];			// each object's bounding sphere
+	double	*radius;
+	int		*items;					// object numbers, in leaf order
+	int		numNodes;
+	struct BvhNode	*nodes;			// nodes[0] is the root; children come after their parent
+	int		depth;					// levels of nodes, the most a query's stack ever holds
+};
+
+
+static void
+BvhNodeBounds( struct Bvh *bvh, struct BvhNode *node )
+{
+	for( int k = 0; k < 3; k++ )
+	{
+		node->min[k] =  1.e300;
+		node->max[k] = -1.e300;
+	}
+	for( int i = node->first; i < node->first + node->count; i++ )
+	{
+		int o = bvh->items[i];
+		for( int k = 0; k < 3; k++ )
+		{
+			double lo = bvh->center[o][k] - bvh->radius[o];
+			double hi = bvh->center[o][k] + bvh->radius[o];
+			if( lo < node->min[k] )		node->min[k] = lo;
+			if( hi > node->max[k] )		node->max[k] = hi;
+		}
+	}
+}
+
+
+// split node (which holds items [first,first+count)) until its leaves are small enough:
+// level is the node's depth, counting the root as 1
+
+static void
+BvhSplit( struct Bvh *bvh, int n, int level )
+{
+	struct BvhNode *node = &bvh->nodes[n];
+	BvhNodeBounds( bvh, node );
+	if( level > bvh->depth )
+		bvh->depth = level;
+	if( node->count <= BVH_LEAF_SIZE )
+		return;
+
+	// partition around the median center along the longest axis (a quickselect):
+	int axis = 0;
+	for( int k = 1; k < 3; k++ )
+		if( node->max[k] - node->min[k] > node->max[axis] - node->min[axis] )
+			axis = k;
+
+	int *items = bvh->items + node->first;
+	int lo = 0, hi = node->count - 1, mid = node->count / 2;
+	while( lo < hi )
+	{
+		double pivot = bvh->center[ items[ (lo + hi) / 2 ] ][axis];
+		int i = lo, j = hi;
+		while( i <= j )
+		{
+			while( bvh->center[ items[i] ][axis] < pivot )	i++;
+			while( bvh->center[ items[j] ][axis] > pivot )	j--;
+			if( i <= j )
+			{
+				int t = items[i];	items[i] = items[j];	items[j] = t;
+				i++;
+				j--;
+			}
+		}
+		if( mid <= j )
+			hi = j;
+		else if( mid >= i )
+			lo = i;
+		else
+			break;
+	}
+
+	int first = node->first, count = node->count;
+	int left = bvh->numNodes++;
+	int right = bvh->numNodes++;
+	node->left = left;
+	node->right = right;
+	node->count = 0;				// no longer a leaf
+	bvh->nodes[left].first  = first;		bvh->nodes[left].count  = mid;
+	bvh->nodes[right].first = first + mid;	bvh->nodes[right].count = count - mid;
+	BvhSplit( bvh, left, level+1 );
+	BvhSplit( bvh, right, level+1 );
+}
+
+
+// what BvhBuild( ) allocates for n objects:
+
+static long long
+BvhBytes( int n )
+{
+	if( n < 1 )
+		n = 1;
+	return (long long)n * ( 3*sizeof(double) + sizeof(double) + sizeof(int) + 2*sizeof(struct BvhNode) );
+}
+
+
+// (re)build the tree over n spheres:
+
+void
+BvhBuild( struct Bvh *bvh, int n, const double (*center)[3], const double *radius )
+{
+	if( bvh->nodes != NULL )
+		MemSub( MEM_OTHER, BvhBytes( bvh->numObjects ) );
+	delete [ ] bvh->center;
+	delete [ ] bvh->radius;
+	delete [ ] bvh->items;
+	delete [ ] bvh->nodes;
+	bvh->numObjects = n;
+	MemAdd( MEM_OTHER, BvhBytes( n ) );
+	bvh->center = new double[ n > 0 ? n : 1 ][3];
+	bvh->radius = new double[ n > 0 ? n : 1 ];
+	bvh->items  = new int[ n > 0 ? n : 1 ];
+	bvh->nodes  = new struct BvhNode[ n > 0 ? 2*n : 1 ];		// a binary tree over n leaves has < 2n nodes
+	for( int i = 0; i < n; i++ )
+	{
+		bvh->center[i][0] = center[i][0];
+		bvh->center[i][1] = center[i][1];
+		bvh->center[i][2] = center[i][2];
+		bvh->radius[i] = radius[i];
+		bvh->items[i] = i;
+	}
+
+	bvh->numNodes = 1;
+	memset( &bvh->nodes[0], 0, sizeof(struct BvhNode) );
+	bvh->nodes[0].count = n;
+	bvh->depth = 0;
+	if( n > 0 )
+		BvhSplit( bvh, 0, 1 );
+	assert( bvh->depth <= BVH_STACK );
+}
+
+
+// move the spheres and refit the boxes, keeping the tree's shape:
+
+void
+BvhRefit( struct Bvh *bvh, const double (*center)[3], const double *radius )
+{
+	memcpy( bvh->center, center, bvh->numObjects * sizeof(bvh->center[0]) );
+	memcpy( bvh->radius, radius, bvh->numObjects * sizeof(double) );
+
+	// children always come after their parent, so walking backwards is bottom-up:
+	for( int n = bvh->numNodes - 1; n >= 0; n-- )
+	{
+		struct BvhNode *node = &bvh->nodes[n];
+		if( node->count > 0  ||  bvh->numObjects == 0 )
+		{
+			BvhNodeBounds( bvh, node );
+			continue;
+		}
+		const struct BvhNode *l = &bvh->nodes[node->left];
+		const struct BvhNode *r = &bvh->nodes[node->right];
+		for( int k = 0; k < 3; k++ )
+		{
+			node->min[k] = l->min[k] < r->min[k] ? l->min[k] : r->min[k];
+			node->max[k] = l->max[k] > r->max[k] ? l->max[k] : r->max[k];
+		}
+	}
+}
+
+
+// 0 = box outside the plane, 1 = straddling, 2 = wholly inside:
+
+static int
+BvhBoxPlane( const struct BvhNode *node, const float *pl )
+{
+	double nearD = pl[3], farD = pl[3];
+	for( int k = 0; k < 3; k++ )
+	{
+		double a = pl[k] * node->min[k], b = pl[k] * node->max[k];
+		nearD += a < b ? a : b;
+		farD  += a < b ? b : a;
+	}
+	if( farD < 0. )
+		return 0;
+	return nearD >= 0. ? 2 : 1;
+}
+
+
+static int
+BvhFrustumNode( const struct Bvh *bvh, int n, const struct Frustum *f, bool inside, int *out, int numOut )
+{
+	const struct BvhNode *node = &bvh->nodes[n];
+	if( ! inside )
+	{
+		inside = true;
+		for( int i = 0; i < f->numPlanes; i++ )
+		{
+			int r = BvhBoxPlane( node, f->planes[i] );
+			if( r == 0 )
+				return numOut;
+			if( r == 1 )
+				inside = false;
+		}
+	}
+
+	if( node->count > 0 )
+	{
+		for( int i = node->first; i < node->first + node->count; i++ )
+		{
+			int o = bvh->items[i];
+			if( inside  ||  FrustumSphereVisible( f, (float)bvh->center[o][0], (float)bvh->center[o][1], (float)bvh->center[o][2], (float)bvh->radius[o] ) )
+				out[numOut++] = o;
+		}
+		return numOut;
+	}
+
+	// once a box is wholly inside, everything under it is too -- no more plane tests:
+	numOut = BvhFrustumNode( bvh, node->left,  f, inside, out, numOut );
+	return   BvhFrustumNode( bvh, node->right, f, inside, out, numOut );
+}
+
+
+// put the numbers of the objects that may be inside the frustum into out[ ], returning how many:
+// out[ ] must have room for every object
+
+int
+BvhQueryFrustum( const struct Bvh *bvh, const struct Frustum *f, int *out )
+{
+	if( bvh->numObjects == 0 )
+		return 0;
+	return BvhFrustumNode( bvh, 0, f, false, out, 0 );
+}
+
+
+// the closest object whose sphere the ray origin + t dir (t >= 0) hits, or -1:
+// *tHit gets its t
+
+int
+BvhQueryRay( const struct Bvh *bvh, const double origin[3], const double dir[3], double *tHit )
+{
+	int best = -1;
+	double bestT = 1.e300;
+	if( bvh->numObjects == 0 )
+		return -1;
+
+	// each step pops a node and pushes at most its two children, so the stack holds at most
+	// one node per level:
+	int stack[ BVH_STACK ];
+	assert( bvh->depth <= BVH_STACK );
+	int top = 0;
+	stack[top++] = 0;
+	while( top > 0 )
+	{
+		const struct BvhNode *node = &bvh->nodes[ stack[--top] ];
+
+		// slab test against the box, giving up if it can't beat the best hit so far:
+		double t0 = 0., t1 = bestT;
+		bool miss = false;
+		for( int k = 0; k < 3  &&  ! miss; k++ )
+		{
+			if( dir[k] == 0. )
+			{
+				miss = origin[k] < node->min[k]  ||  origin[k] > node->max[k];
+				continue;
+			}
+			double ta = ( node->min[k] - origin[k] ) / dir[k];
+			double tb = ( node->max[k] - origin[k] ) / dir[k];
+			if( ta > tb )	{ double t = ta;  ta = tb;  tb = t; }
+			if( ta > t0 )	t0 = ta;
+			if( tb < t1 )	t1 = tb;
+			miss = t0 > t1;
+		}
+		if( miss )
+			continue;
+
+		if( node->count == 0 )
+		{
+			assert( top + 2 <= BVH_STACK );
+			stack[top++] = node->left;
+			stack[top++] = node->right;
+			continue;
+		}
+
+		for( int i = node->first; i < node->first + node->count; i++ )
+		{
+			int o = bvh->items[i];
+			double oc[3] = { origin[0] - bvh->center[o][0], origin[1] - bvh->center[o][1], origin[2] - bvh->center[o][2] };
+			double a = dir[0]*dir[0] + dir[1]*dir[1] + dir[2]*dir[2];
+			double b = oc[0]*dir[0] + oc[1]*dir[1] + oc[2]*dir[2];
+			double c = oc[0]*oc[0] + oc[1]*oc[1] + oc[2]*oc[2] - bvh->radius[o]*bvh->radius[o];
+			double disc = b*b - a*c;
+			if( disc < 0. )
+				continue;
+			double t = ( -b - sqrt( disc ) ) / a;
+			if( t < 0. )
+				t = ( -b + sqrt( disc ) ) / a;		// the ray starts inside the sphere
+			if( t >= 0.  &&  t < bestT )
+			{
+				bestT = t;
+				best = o;
+			}
+		}
+	}
+
+	*tHit = bestT;
+	return best;
+}
+
+
+// put the numbers of the objects whose spheres come within r of p into out[ ], returning how many:
+
+int
+BvhQueryRadius( const struct Bvh *bvh, const double p[3], double r, int *out )
+{
+	int numOut = 0;
+	if( bvh->numObjects == 0 )
+		return 0;
+
+	int stack[ BVH_STACK ];
+	assert( bvh->depth <= BVH_STACK );
+	int top = 0;
+	stack[top++] = 0;
+	while( top > 0 )
+	{
+		const struct BvhNode *node = &bvh->nodes[ stack[--top] ];
+
+		// distance from p to the box:
+		double d2 = 0.;
+		for( int k = 0; k < 3; k++ )
+		{
+			double d = p[k] < node->min[k] ? node->min[k] - p[k] : ( p[k] > node->max[k] ? p[k] - node->max[k] : 0. );
+			d2 += d * d;
+		}
+		if( d2 > r * r )
+			continue;
+
+		if( node->count == 0 )
+		{
+			assert( top + 2 <= BVH_STACK );
+			stack[top++] = node->left;
+			stack[top++] = node->right;
+			continue;
+		}
+
+		for( int i = node->first; i < node->first + node->count; i++ )
+		{
+			int o = bvh->items[i];
+			double dx = bvh->center[o][0] - p[0], dy = bvh->center[o][1] - p[1], dz = bvh->center[o][2] - p[2];
+			double reach = r + bvh->radius[o];
+			if( dx*dx + dy*dy + dz*dz <= reach * reach )
+				out[numOut++] = o;
+		}
+	}
+	return numOut;
+}
@@ -0,0 +1,233 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+// precomputed chebyshev ephemeris cache:
+//
+//	MakeChebyshevFile( ) samples every body of an Ephemeris over a date range and fits each
+//	coordinate of each fixed-length segment with a chebyshev series
+//	the file is a small header followed by the coefficients, segment-major, so one lookup
+//	touches one contiguous block:
+//		coeffs[ segment ][ body ][ x,y,z ][ coefficient ]
+//	at runtime the file is memory-mapped as-is, and a position is a segment index plus a
+//	short clenshaw recurrence -- the cost doesn't depend on how the positions were made
+//	body k of the file is ephemeris slot k, which only means something for the system it was
+//	made from, so the header keeps that system's body count and SystemChecksum( );
+//	OpenChebyshevFile( ) turns down a file made for some other system -- it's the user's, and
+//	another run may have it mapped, so it isn't rewritten -- and the elements are used instead
+
+#define CHEBY_MAGIC				0x43485045		// "EPHC"
+#define CHEBY_VERSION			2
+#define CHEBY_DEFAULT_COEFFS	14
+#define CHEBY_DEFAULT_DAYS		32.			// short enough for mercury's 88-day orbit
+#define CHEBY_MAX_COEFFS		32
+
+struct ChebyshevHeader
+{
+	int		magic;
+	int		version;
+	int		numBodies;
+	int		numCoeffs;
+	int		numSegments;
+	int		systemBodies;					// the system it was made from
+	unsigned int	systemSum;
+	int		pad[2];
+	double	startJD;
+	double	segmentDays;
+};
+
+struct ChebyshevCache
+{
+	const struct ChebyshevHeader	*header;	// NULL if no file is mapped
+	const double					*coeffs;
+	struct MappedFile				file;
+};
+
+
+// fit every body in eph between startJD and endJD and write the result to a file, marked as made
+// from a system of systemBodies bodies with SystemChecksum( ) systemSum:
+// returns false if the file can't be written
+
+bool
+MakeChebyshevFile( struct Ephemeris *eph, double startJD, double endJD, double segmentDays, int numCoeffs,
+				   int systemBodies, unsigned int systemSum, const char *filename )
+{
+	if( numCoeffs < 2  ||  numCoeffs > CHEBY_MAX_COEFFS  ||  segmentDays <= 0.  ||  endJD <= startJD )
+	{
+		fprintf( stderr, "Bad ephemeris cache parameters\n" );
+		return false;
+	}
+
+	FILE *fp = fopen( filename, "wb" );
+	if( fp == NULL )
+	{
+		fprintf( stderr, "Cannot write ephemeris cache '%s'\n", filename );
+		return false;
+	}
+
+	struct ChebyshevHeader header;
+	memset( &header, 0, sizeof(header) );
+	header.magic       = CHEBY_MAGIC;
+	header.version     = CHEBY_VERSION;
+	header.numBodies   = eph->n;
+	header.numCoeffs   = numCoeffs;
+	header.numSegments = (int)ceil( ( endJD - startJD ) / segmentDays );
+	header.systemBodies = systemBodies;
+	header.systemSum   = systemSum;
+	header.startJD     = startJD;
+	header.segmentDays = segmentDays;
+	fwrite( &header, sizeof(header), 1, fp );
+
+	// sample at the chebyshev nodes of each segment -- every body at once, so the
+	// ephemeris stays one pass per node -- then project onto the first numCoeffs polynomials:
+
+	const int n = eph->n;
+	const int perSegment = n * 3 * numCoeffs;
+	double *samples = new double[ numCoeffs * n * 3 ];		// [ node ][ body ][ x,y,z ]
+	double *coeffs  = new double[ perSegment ];
+	for( int s = 0; s < header.numSegments; s++ )
+	{
+		double t0 = startJD + s * segmentDays;
+		for( int j = 0; j < numCoeffs; j++ )
+		{
+			double u = cos( M_PI * ( j + 0.5 ) / numCoeffs );		// node in [-1,1]
+			EphemerisEvaluate( eph, t0 + ( u + 1. ) * 0.5 * segmentDays );
+			for( int b = 0; b < n; b++ )
+			{
+				samples[ ( j*n + b )*3 + 0 ] = eph->x[b];
+				samples[ ( j*n + b )*3 + 1 ] = eph->y[b];
+				samples[ ( j*n + b )*3 + 2 ] = eph->z[b];
+			}
+		}
+
+		for( int b = 0; b < n; b++ )
+		{
+			for( int c = 0; c < 3; c++ )
+			{
+				for( int k = 0; k < numCoeffs; k++ )
+				{
+					double sum = 0.;
+					for( int j = 0; j < numCoeffs; j++ )
+						sum += samples[ ( j*n + b )*3 + c ] * cos( M_PI * k * ( j + 0.5 ) / numCoeffs );
+					coeffs[ ( b*3 + c )*numCoeffs + k ] = ( k == 0 ? 1. : 2. ) * sum / numCoeffs;
+				}
+			}
+		}
+		fwrite( coeffs, sizeof(double), perSegment, fp );
+	}
+
+	delete [ ] samples;
+	delete [ ] coeffs;
+	bool ok = ferror( fp ) == 0;
+	fclose( fp );
+	if( ! ok )
+		fprintf( stderr, "Error writing ephemeris cache '%s'\n", filename );
+	return ok;
+}
+
+
+// release a mapped cache:
+
+void
+UnmapChebyshevFile( struct ChebyshevCache *cache )
+{
+	UnmapFile( &cache->file );
+	cache->header = NULL;
+	cache->coeffs = NULL;
+}
+
+
+// map an ephemeris cache file:
+// returns false, with cache->header NULL, if it can't be opened or doesn't look right
+
+bool
+MapChebyshevFile( struct ChebyshevCache *cache, const char *filename )
+{
+	cache->header = NULL;
+	cache->coeffs = NULL;
+	if( ! MapFile( &cache->file, filename ) )
+		return false;
+
+	const struct ChebyshevHeader *h = (const struct ChebyshevHeader *)cache->file.base;
+	size_t size = cache->file.size;
+	size_t needed = sizeof(*h);
+	if( size >= sizeof(*h) )
+		needed += (size_t)h->numSegments * h->numBodies * 3 * h->numCoeffs * sizeof(double);
+	if( size < sizeof(*h)  ||  h->magic != CHEBY_MAGIC  ||  h->version != CHEBY_VERSION
+		||  h->numCoeffs < 2  ||  h->numCoeffs > CHEBY_MAX_COEFFS  ||  size < needed )
+	{
+		if( size >= sizeof(*h)  &&  h->magic == CHEBY_MAGIC  &&  h->version != CHEBY_VERSION )
+			fprintf( stderr, "'%s' is from another version of the ephemeris cache, remake it with -makeephem\n", filename );
+		else
+			fprintf( stderr, "'%s' is not an ephemeris cache file\n", filename );
+		UnmapFile( &cache->file );
+		return false;
+	}
+
+	cache->header = h;
+	cache->coeffs = (const double *)( h + 1 );
+	return true;
+}
+
+
+// map an ephemeris cache for the bodies of eph, which come from a system of systemBodies bodies
+// with SystemChecksum( ) systemSum:
+// returns false, with cache->header NULL, if there's no usable cache -- including one made from
+// some other system
+
+bool
+OpenChebyshevFile( struct ChebyshevCache *cache, const struct Ephemeris *eph, int systemBodies, unsigned int systemSum, const char *filename )
+{
+	if( ! MapChebyshevFile( cache, filename ) )
+		return false;
+	const struct ChebyshevHeader *h = cache->header;
+	if( h->numBodies == eph->n  &&  h->systemBodies == systemBodies  &&  h->systemSum == systemSum )
+		return true;
+
+	fprintf( stderr, "'%s' was made for a different system, so the orbital elements will be used -- "
+		"remake it for this one with -makeephem\n", filename );
+	UnmapChebyshevFile( cache );
+	return false;
+}
+
+
+// true if the cache has body b at julian date jd:
+
+inline
+bool
+ChebyshevCovers( const struct ChebyshevCache *cache, int b, double jd )
+{
+	const struct ChebyshevHeader *h = cache->header;
+	return h != NULL  &&  b >= 0  &&  b < h->numBodies
+		&&  jd >= h->startJD  &&  jd <= h->startJD + h->numSegments * h->segmentDays;
+}
+
+
+// heliocentric position of body b at julian date jd, AU:
+// the caller checks ChebyshevCovers( ) first
+
+void
+ChebyshevPosition( const struct ChebyshevCache *cache, int b, double jd, double xyz[3] )
+{
+	const struct ChebyshevHeader *h = cache->header;
+	double t = ( jd - h->startJD ) / h->segmentDays;
+	int s = (int)t;
+	if( s >= h->numSegments )		// jd at the very end of the range
+		s = h->numSegments - 1;
+	double u = 2. * ( t - s ) - 1.;		// [-1,1] within the segment
+
+	const int nc = h->numCoeffs;
+	const double *c = cache->coeffs + ( (size_t)s * h->numBodies + b ) * 3 * nc;
+	for( int k = 0; k < 3; k++, c += nc )
+	{
+		// clenshaw's recurrence for sum c[i] T_i(u), with c[0] already halved:
+		double b1 = 0., b2 = 0.;
+		for( int i = nc - 1; i >= 1; i-- )
+		{
+			double b0 = 2. * u * b1 - b2 + c[i];
+			b2 = b1;
+			b1 = b0;
+		}
+		xyz[k] = u * b1 - b2 + c[0];
+	}
+}
@@ -0,0 +1,92 @@
+#include <stdio.h>
+#include <math.h>
+
+// view-frustum culling against bounding spheres:
+//
+//	FrustumFromGL( ) pulls the planes out of the current projection * modelview
+//	(Gribb & Hartmann), so a point or sphere given in the coordinates glVertex( ) would see
+//	at that moment can be tested directly -- for us, the ship-relative scene coordinates
+//	that the scene graph's matrices produce
+//	the planes are normalized, so a signed distance is in the same units as the radius
+
+#define FRUSTUM_LEFT		0
+#define FRUSTUM_RIGHT		1
+#define FRUSTUM_BOTTOM		2
+#define FRUSTUM_TOP			3
+#define FRUSTUM_FAR			4
+
+struct Frustum
+{
+	int		numPlanes;
+	float	planes[5][4];		// a x + b y + c z + d >= 0 is inside
+};
+
+struct CullStats
+{
+	int		bodiesDrawn, bodiesTotal;
+	int		partsDrawn, partsTotal;
+	int		starsDrawn, starsTotal;
+	int		chunksDrawn, chunksTotal;
+	int		clustersDrawn, clustersTotal;	// belt clusters
+};
+
+
+// get the frustum planes for the current matrices:
+// the near plane is left out -- with a perspective projection the four side planes already
+// meet at the eye -- and so is the far one when there isn't a finite far plane (reversed-z)
+
+void
+FrustumFromGL( struct Frustum *f, bool useFar )
+{
+	float p[16], mv[16], m[16];
+	glGetFloatv( GL_PROJECTION_MATRIX, p );
+	glGetFloatv( GL_MODELVIEW_MATRIX, mv );
+	for( int c = 0; c < 4; c++ )
+		for( int r = 0; r < 4; r++ )
+			m[4*c+r] = p[r]*mv[4*c] + p[4+r]*mv[4*c+1] + p[8+r]*mv[4*c+2] + p[12+r]*mv[4*c+3];
+
+	// row i of the column-major m is m[i], m[4+i], m[8+i], m[12+i]:
+	static const int   row[5]  = { 0, 0, 1, 1, 2 };
+	static const float sign[5] = { 1.f, -1.f, 1.f, -1.f, -1.f };
+	f->numPlanes = useFar ? 5 : 4;
+	for( int i = 0; i < f->numPlanes; i++ )
+	{
+		float *pl = f->planes[i];
+		for( int k = 0; k < 4; k++ )
+			pl[k] = m[4*k+3] + sign[i] * m[4*k+row[i]];
+		float len = sqrtf( pl[0]*pl[0] + pl[1]*pl[1] + pl[2]*pl[2] );
+		if( len > 0.f )
+		{
+			pl[0] /= len;	pl[1] /= len;	pl[2] /= len;	pl[3] /= len;
+		}
+	}
+}
+
+
+// true if any part of the sphere can be inside the frustum:
+
+inline
+bool
+FrustumSphereVisible( const struct Frustum *f, float x, float y, float z, float radius )
+{
+	for( int i = 0; i < f->numPlanes; i++ )
+	{
+		const float *pl = f->planes[i];
+		if( pl[0]*x + pl[1]*y + pl[2]*z + pl[3] < -radius )
+			return false;
+	}
+	return true;
+}
+
+
+// the same for a sphere given in a node's frame, where m is the node's column-major matrix:
+
+inline
+bool
+FrustumSphereVisible( const struct Frustum *f, const float m[16], float cx, float cy, float cz, float radius )
+{
+	float x = m[0]*cx + m[4]*cy + m[8]*cz  + m[12];
+	float y = m[1]*cx + m[5]*cy + m[9]*cz  + m[13];
+	float z = m[2]*cx + m[6]*cy + m[10]*cz + m[14];
+	return FrustumSphereVisible( f, x, y, z, radius );
+}
@@ -0,0 +1,161 @@
+#include <stdio.h>
+#include <math.h>
+
+// keplerian ephemeris engine:
+//
+//	each body is a set of osculating elements at J2000 plus their rates per julian century
+//	(the form used by JPL's "Keplerian Elements for Approximate Positions of the Major Planets")
+//	everything is stored structure-of-arrays, and EphemerisEvaluate( ) runs one pass per stage over
+//	all bodies -- the loops have no branches or calls other than sin/cos/sqrt, so the compiler can
+//	vectorize them (gcc -O3, msvc /O2 with svml; gcc also needs -ffast-math to call libmvec's
+//	vector sin/cos, but sample.cpp includes every file, so that flag applies to the whole program)
+
+#define J2000_JD			2451545.0
+#define DAYS_PER_CENTURY	36525.0
+#define MILES_PER_AU		92955807.3
+#define KEPLER_ITERATIONS	6			// newton steps, plenty for e < 0.9
+#define DEG2RAD				( M_PI / 180. )
+
+struct OrbitalElements
+{
+	double a, e, inc, L, wbar, node;			// AU, -, deg, deg (mean longitude), deg (long. of perihelion), deg (long. of asc. node)
+	double da, de, dinc, dL, dwbar, dnode;		// the same, per julian century
+};
+
+struct Ephemeris
+{
+	int		n, capacity;
+	double	*a, *e, *inc, *L, *wbar, *node;
+	double	*da, *de, *dinc, *dL, *dwbar, *dnode;
+	double	*M, *E, *w, *ecc;					// scratch: mean, eccentric anomaly, arg. of perihelion, eccentricity
+	double	*x, *y, *z;							// heliocentric ecliptic J2000 position at the last epoch, AU
+	double	epoch;								// julian date of the last EphemerisEvaluate( )
+};
+
+// grow all the arrays of an ephemeris to hold at least n bodies:
+
+void
+EphemerisReserve( struct Ephemeris *eph, int n )
+{
+	if( n <= eph->capacity )
+		return;
+
+	int capacity = eph->capacity == 0 ? 16 : eph->capacity;
+	while( capacity < n )
+		capacity *= 2;
+
+	double **arrays[ ] = { &eph->a, &eph->e, &eph->inc, &eph->L, &eph->wbar, &eph->node,
+						   &eph->da, &eph->de, &eph->dinc, &eph->dL, &eph->dwbar, &eph->dnode,
+						   &eph->M, &eph->E, &eph->w, &eph->ecc, &eph->x, &eph->y, &eph->z };
+	for( unsigned int i = 0; i < sizeof(arrays) / sizeof(arrays[0]); i++ )
+	{
+		MemAdd( MEM_OTHER, ( capacity - eph->capacity ) * (long long)sizeof(double) );
+		double *grown = new double[ capacity ];
+		for( int j = 0; j < eph->n; j++ )
+			grown[j] = (*arrays[i])[j];
+		delete [ ] *arrays[i];
+		*arrays[i] = grown;
+	}
+	eph->capacity = capacity;
+}
+
+
+// add a body, returning its index:
+
+int
+EphemerisAdd( struct Ephemeris *eph, const struct OrbitalElements *el )
+{
+	EphemerisReserve( eph, eph->n + 1 );
+	int i = eph->n++;
+	eph->a[i] = el->a;		eph->e[i] = el->e;		eph->inc[i] = el->inc;
+	eph->L[i] = el->L;		eph->wbar[i] = el->wbar;	eph->node[i] = el->node;
+	eph->da[i] = el->da;	eph->de[i] = el->de;	eph->dinc[i] = el->dinc;
+	eph->dL[i] = el->dL;	eph->dwbar[i] = el->dwbar;	eph->dnode[i] = el->dnode;
+	eph->x[i] = eph->y[i] = eph->z[i] = 0.;
+	return i;
+}
+
+
+// solve kepler's equation E - e sin E = M for a batch of bodies (radians):
+// a fixed number of newton steps keeps the loop branch-free so it vectorizes
+
+void
+SolveKeplerBatch( const double *M, const double *e, double *E, int n )
+{
+	for( int i = 0; i < n; i++ )
+	{
+		double ei = e[i];
+		double Mi = M[i];
+		double Ei = Mi + ei * sin( Mi );
+		for( int k = 0; k < KEPLER_ITERATIONS; k++ )
+			Ei -= ( Ei - ei * sin( Ei ) - Mi ) / ( 1. - ei * cos( Ei ) );
+		E[i] = Ei;
+	}
+}
+
+
+// compute every body's heliocentric position at julian date jd:
+
+void
+EphemerisEvaluate( struct Ephemeris *eph, double jd )
+{
+	const int n = eph->n;
+	const double T = ( jd - J2000_JD ) / DAYS_PER_CENTURY;
+	double * __restrict M = eph->M;
+	double * __restrict w = eph->w;
+	double * __restrict ecc = eph->ecc;
+
+	// mean anomaly in [-pi,pi), argument of perihelion, and the current eccentricity:
+
+	for( int i = 0; i < n; i++ )
+	{
+		double L    = eph->L[i]    + eph->dL[i]    * T;
+		double wbar = eph->wbar[i] + eph->dwbar[i] * T;
+		double m    = ( L - wbar ) / 360.;
+		M[i]   = 2. * M_PI * ( m - floor( m + 0.5 ) );
+		w[i]   = ( wbar - ( eph->node[i] + eph->dnode[i] * T ) ) * DEG2RAD;
+		ecc[i] = eph->e[i] + eph->de[i] * T;
+	}
+
+	SolveKeplerBatch( M, ecc, eph->E, n );
+
+	// position in the orbital plane, then rotated into the ecliptic:
+
+	for( int i = 0; i < n; i++ )
+	{
+		double e    = ecc[i];
+		double a    = eph->a[i]    + eph->da[i]    * T;
+		double inc  = ( eph->inc[i]  + eph->dinc[i]  * T ) * DEG2RAD;
+		double node = ( eph->node[i] + eph->dnode[i] * T ) * DEG2RAD;
+		double E    = eph->E[i];
+
+		double xp = a * ( cos( E ) - e );
+		double yp = a * sqrt( 1. - e*e ) * sin( E );
+
+		double cw = cos( w[i] ),	sw = sin( w[i] );
+		double cn = cos( node ),	sn = sin( node );
+		double ci = cos( inc ),		si = sin( inc );
+
+		eph->x[i] = ( cw*cn - sw*sn*ci ) * xp + ( -sw*cn - cw*sn*ci ) * yp;
+		eph->y[i] = ( cw*sn + sw*cn*ci ) * xp + ( -sw*sn + cw*cn*ci ) * yp;
+		eph->z[i] = ( sw*si ) * xp + ( cw*si ) * yp;
+	}
+
+	eph->epoch = jd;
+}
+
+
+// julian date of a gregorian calendar date (day may have a fraction), from Meeus:
+
+double
+JulianDate( int year, int month, double day )
+{
+	if( month <= 2 )
+	{
+		year  -= 1;
+		month += 12;
+	}
+	int A = year / 100;
+	int B = 2 - A + A / 4;
+	return floor( 365.25 * ( year + 4716 ) ) + floor( 30.6001 * ( month + 1 ) ) + day + B - 1524.5;
+}
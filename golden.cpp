@@ -0,0 +1,167 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+
+// golden-image checks, so an optimization can be shown to leave the picture alone:
+//
+//	with -golden DIR, the scenarios (see scenario.cpp) are drawn offscreen at a fixed size, and
+//	each frame a scenario captures is compared with DIR/scenario-frame.ppm:
+//		psnr		over all the pixels' rgb, in db -- must be at least -psnr (40 by default)
+//		visible		pixels with a channel off by more than GOLDEN_VISIBLE -- at most
+//					GOLDEN_MAX_VISIBLE of them; psnr alone forgives a small thing gone entirely
+//	a frame that fails gets DIR/scenario-frame.new.ppm (what was drawn) and
+//	DIR/scenario-frame.diff.ppm (the reference, dimmed, with the differences in red) beside it
+//	-savegolden DIR writes the references instead, for when a change to the picture is meant
+
+#define GOLDEN_PSNR_DB		40.
+#define GOLDEN_PSNR_SAME	99.			// what identical images report, rather than infinity
+#define GOLDEN_VISIBLE		16			// out of 255
+#define GOLDEN_MAX_VISIBLE	.001		// a fraction of the pixels
+
+#define GOLDEN_PASSED		0
+#define GOLDEN_FAILED		1
+#define GOLDEN_MISSING		2			// no reference to compare with
+#define GOLDEN_SAVED		3			// -savegolden
+#define NUM_GOLDEN_STATUS	4
+
+static const char *	GoldenStatusNames[NUM_GOLDEN_STATUS] = { "passed", "failed", "missing", "saved" };
+
+struct GoldenResult
+{
+	char	name[ 64 ];				// scenario-frame
+	int		status;
+	double	psnr;
+	double	visible;				// fraction of the pixels
+};
+
+const char *	GoldenDir;			// set with -golden or -savegolden
+bool			GoldenSave;
+double			GoldenPsnr = GOLDEN_PSNR_DB;		// set with -psnr
+std::vector<struct GoldenResult>	GoldenResults;
+
+
+// compare two same-sized rgb images: returns the psnr, and the fraction of pixels visibly different:
+
+double
+ImagePsnr( const unsigned char *a, const unsigned char *b, int numPixels, double *visible )
+{
+	double sumSq = 0.;
+	int numVisible = 0;
+	for( int p = 0; p < numPixels; p++ )
+	{
+		int worst = 0;
+		for( int c = 0; c < 3; c++ )
+		{
+			int d = (int)a[3*p+c] - (int)b[3*p+c];
+			sumSq += d * d;
+			if( abs( d ) > worst )
+				worst = abs( d );
+		}
+		if( worst > GOLDEN_VISIBLE )
+			numVisible++;
+	}
+	*visible = numPixels > 0 ? (double)numVisible / numPixels : 0.;
+	if( sumSq == 0. )
+		return GOLDEN_PSNR_SAME;
+	double mse = sumSq / ( 3. * numPixels );
+	double psnr = 10. * log10( 255. * 255. / mse );
+	return psnr < GOLDEN_PSNR_SAME ? psnr : GOLDEN_PSNR_SAME;
+}
+
+
+// the reference at a quarter brightness, in gray, with each pixel's difference on top in red:
+
+bool
+WriteDiffImage( const char *filename, const unsigned char *reference, const unsigned char *now, int width, int height )
+{
+	int n = width * height;
+	unsigned char *diff = new unsigned char[ 3 * n ];
+	for( int p = 0; p < n; p++ )
+	{
+		int gray = ( reference[3*p] + reference[3*p+1] + reference[3*p+2] ) / 12;
+		int worst = 0;
+		for( int c = 0; c < 3; c++ )
+		{
+			int d = abs( (int)reference[3*p+c] - (int)now[3*p+c] );
+			if( d > worst )
+				worst = d;
+		}
+		int red = gray + 4 * worst;
+		diff[3*p+0] = (unsigned char)( red < 255 ? red : 255 );
+		diff[3*p+1] = (unsigned char)gray;
+		diff[3*p+2] = (unsigned char)gray;
+	}
+	bool ok = WritePpm( filename, diff, width, height );
+	delete [ ] diff;
+	return ok;
+}
+
+
+// check (or with -savegolden, save) frame of scenario, drawn as rgb -- false if it failed:
+
+bool
+GoldenCheck( const char *scenario, int frame, const unsigned char *rgb, int width, int height )
+{
+	struct GoldenResult r;
+	snprintf( r.name, sizeof(r.name), "%s-%d", scenario, frame );
+	r.psnr = 0.;
+	r.visible = 0.;
+
+	char path[ 512 ];
+	snprintf( path, sizeof(path), "%s/%s.ppm", GoldenDir, r.name );
+	if( GoldenSave )
+	{
+		r.status = WritePpm( path, rgb, width, height ) ? GOLDEN_SAVED : GOLDEN_FAILED;
+		GoldenResults.push_back( r );
+		return r.status != GOLDEN_FAILED;
+	}
+
+	int refWidth, refHeight;
+	unsigned char *reference = ReadPpm( path, &refWidth, &refHeight );
+	if( reference == NULL )
+	{
+		fprintf( stderr, "No golden image '%s' -- make one with -savegolden\n", path );
+		r.status = GOLDEN_MISSING;
+	}
+	else if( refWidth != width  ||  refHeight != height )
+	{
+		fprintf( stderr, "Golden image '%s' is %d x %d, not %d x %d -- use the -size it was made with\n",
+			path, refWidth, refHeight, width, height );
+		r.status = GOLDEN_FAILED;
+	}
+	else
+	{
+		r.psnr = ImagePsnr( reference, rgb, width * height, &r.visible );
+		r.status = r.psnr >= GoldenPsnr  &&  r.visible <= GOLDEN_MAX_VISIBLE ? GOLDEN_PASSED : GOLDEN_FAILED;
+		if( r.status == GOLDEN_FAILED )
+		{
+			fprintf( stderr, "Golden image '%s' differs: psnr %.2f db (at least %.2f), %.3f%% of pixels visibly different (at most %.3f%%)\n",
+				path, r.psnr, GoldenPsnr, 100. * r.visible, 100. * GOLDEN_MAX_VISIBLE );
+			snprintf( path, sizeof(path), "%s/%s.new.ppm", GoldenDir, r.name );
+			WritePpm( path, rgb, width, height );
+			snprintf( path, sizeof(path), "%s/%s.diff.ppm", GoldenDir, r.name );
+			WriteDiffImage( path, reference, rgb, width, height );
+		}
+	}
+	delete [ ] reference;
+	GoldenResults.push_back( r );
+	return r.status == GOLDEN_PASSED;
+}
+
+
+// write  "images": [ ... ]  with no comma or newline after it, each line starting with indent:
+
+void
+GoldenReportJson( FILE *fp, const char *indent )
+{
+	fprintf( fp, "%s\"images\": [\n", indent );
+	for( unsigned int i = 0; i < GoldenResults.size( ); i++ )
+	{
+		const struct GoldenResult *r = &GoldenResults[i];
+		fprintf( fp, "%s  { \"name\": \"%s\", \"status\": \"%s\", \"psnr_db\": %.2f, \"visible_fraction\": %.6f }%s\n", indent,
+			r->name, GoldenStatusNames[r->status], r->psnr, r->visible, i == GoldenResults.size( ) - 1 ? "" : "," );
+	}
+	fprintf( fp, "%s]", indent );
+}
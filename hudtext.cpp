@@ -0,0 +1,189 @@
+#include <stdio.h>
+#include <string.h>
+#include <GL/gl.h>
+
+// glyph-atlas text for the heads-up display:
+//
+//	the glut bitmap font is rasterized once into an alpha texture
+//	each HudString keeps its own quad arrays, which are only rebuilt when
+//	its text or the viewport size changes, and is drawn with one glDrawArrays( )
+
+#define ATLAS_FIRST_CHAR	32		// ' '
+#define ATLAS_LAST_CHAR		126		// '~'
+#define ATLAS_NUM_CHARS		( ATLAS_LAST_CHAR - ATLAS_FIRST_CHAR + 1 )
+#define ATLAS_COLS			16
+#define ATLAS_CELL			32		// pixels, big enough for the 24-point fonts
+#define ATLAS_BASELINE		8		// baseline height inside a cell, leaves room for descenders
+#define ATLAS_WIDTH			( ATLAS_COLS * ATLAS_CELL )
+#define ATLAS_HEIGHT		256		// next power of two above 6 rows of cells
+
+#define HUD_MAX_CHARS		128
+
+struct HudString
+{
+	char	text[HUD_MAX_CHARS];	// what the arrays currently hold
+	float	x, y;					// lower-left of the text, in percent of the viewport
+	int		viewport;				// viewport size the arrays were built for
+	int		numVerts;
+	GLfloat	verts[HUD_MAX_CHARS * 4 * 2];
+	GLfloat	texcoords[HUD_MAX_CHARS * 4 * 2];
+};
+
+GLuint	GlyphAtlasTex;
+int		GlyphAdvance[ATLAS_NUM_CHARS];	// pixels to move the pen after each glyph
+bool	GlyphAtlasReady = false;
+bool	GlyphAtlasTried = false;
+
+
+// rasterize the printable ascii characters of a glut bitmap font into the atlas:
+// this draws into the back buffer, so call it before the frame's glClear( )
+
+bool
+BuildGlyphAtlas( void *font )
+{
+	GlyphAtlasTried = true;
+
+	if( glutGet( GLUT_WINDOW_WIDTH ) < ATLAS_WIDTH  ||  glutGet( GLUT_WINDOW_HEIGHT ) < ATLAS_HEIGHT )
+	{
+		fprintf( stderr, "Window too small to build the glyph atlas, using raster text\n" );
+		return false;
+	}
+
+	glPushAttrib( GL_ALL_ATTRIB_BITS );
+	glDisable( GL_LIGHTING );
+	glDisable( GL_DEPTH_TEST );
+	glDisable( GL_TEXTURE_2D );
+	glDisable( GL_FOG );
+
+	glViewport( 0, 0, ATLAS_WIDTH, ATLAS_HEIGHT );
+	glMatrixMode( GL_PROJECTION );
+	glPushMatrix( );
+	glLoadIdentity( );
+	gluOrtho2D( 0., (double)ATLAS_WIDTH, 0., (double)ATLAS_HEIGHT );
+	glMatrixMode( GL_MODELVIEW );
+	glPushMatrix( );
+	glLoadIdentity( );
+
+	glDrawBuffer( GL_BACK );
+	glClearColor( 0., 0., 0., 1. );
+	glClear( GL_COLOR_BUFFER_BIT );
+	glColor3f( 1., 1., 1. );
+
+	for( int i = 0; i < ATLAS_NUM_CHARS; i++ )
+	{
+		int c = ATLAS_FIRST_CHAR + i;
+		glRasterPos2i( ( i % ATLAS_COLS ) * ATLAS_CELL, ( i / ATLAS_COLS ) * ATLAS_CELL + ATLAS_BASELINE );
+		glutBitmapCharacter( font, c );
+		GlyphAdvance[i] = glutBitmapWidth( font, c );
+	}
+
+	unsigned char *alpha = new unsigned char[ ATLAS_WIDTH * ATLAS_HEIGHT ];
+	glReadBuffer( GL_BACK );
+	glPixelStorei( GL_PACK_ALIGNMENT, 1 );
+	glReadPixels( 0, 0, ATLAS_WIDTH, ATLAS_HEIGHT, GL_RED, GL_UNSIGNED_BYTE, alpha );
+
+	glGenTextures( 1, &GlyphAtlasTex );
+	glBindTexture( GL_TEXTURE_2D, GlyphAtlasTex );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+	glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+	glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+	glTexImage2D( GL_TEXTURE_2D, 0, GL_ALPHA, ATLAS_WIDTH, ATLAS_HEIGHT, 0, GL_ALPHA, GL_UNSIGNED_BYTE, alpha );
+	delete [ ] alpha;
+
+	glMatrixMode( GL_PROJECTION );
+	glPopMatrix( );
+	glMatrixMode( GL_MODELVIEW );
+	glPopMatrix( );
+	glPopAttrib( );
+
+	GlyphAtlasReady = true;
+	return true;
+}
+
+
+// set a hud string's text and position, rebuilding its quads only if something changed:
+// x and y are in percent of the viewport, like the gluOrtho2D( 0, 100, 0, 100 ) text in Display( )
+
+void
+HudSetText( struct HudString *hs, float x, float y, int viewport, const char *text )
+{
+	if( hs->numVerts > 0  &&  hs->viewport == viewport  &&  hs->x == x  &&  hs->y == y  &&  strcmp( hs->text, text ) == 0 )
+		return;
+
+	strncpy( hs->text, text, HUD_MAX_CHARS-1 );
+	hs->text[HUD_MAX_CHARS-1] = '\0';
+	hs->x = x;
+	hs->y = y;
+	hs->viewport = viewport;
+	hs->numVerts = 0;
+
+	float pen = x * (float)viewport / 100.f;
+	float y0  = y * (float)viewport / 100.f - ATLAS_BASELINE;
+	float y1  = y0 + ATLAS_CELL;
+	GLfloat *v = hs->verts;
+	GLfloat *t = hs->texcoords;
+	for( const char *s = hs->text; *s != '\0'; s++ )
+	{
+		int i = (unsigned char)*s - ATLAS_FIRST_CHAR;
+		if( i < 0  ||  i >= ATLAS_NUM_CHARS )
+			continue;
+
+		float s0 = (float)( ( i % ATLAS_COLS ) * ATLAS_CELL ) / (float)ATLAS_WIDTH;
+		float t0 = (float)( ( i / ATLAS_COLS ) * ATLAS_CELL ) / (float)ATLAS_HEIGHT;
+		float s1 = s0 + (float)ATLAS_CELL / (float)ATLAS_WIDTH;
+		float t1 = t0 + (float)ATLAS_CELL / (float)ATLAS_HEIGHT;
+		float x1 = pen + ATLAS_CELL;
+
+		*v++ = pen;	*v++ = y0;	*t++ = s0;	*t++ = t0;
+		*v++ = x1;	*v++ = y0;	*t++ = s1;	*t++ = t0;
+		*v++ = x1;	*v++ = y1;	*t++ = s1;	*t++ = t1;
+		*v++ = pen;	*v++ = y1;	*t++ = s0;	*t++ = t1;
+		hs->numVerts += 4;
+
+		pen += GlyphAdvance[i];
+	}
+}
+
+
+// draw a hud string in the current color:
+// sets up its own pixel-unit projection for the current viewport
+
+void
+HudDrawString( struct HudString *hs )
+{
+	if( hs->numVerts == 0 )
+		return;
+
+	glPushAttrib( GL_ENABLE_BIT | GL_TEXTURE_BIT | GL_COLOR_BUFFER_BIT );
+	glDisable( GL_LIGHTING );
+	glDisable( GL_DEPTH_TEST );
+	glEnable( GL_TEXTURE_2D );
+	glBindTexture( GL_TEXTURE_2D, GlyphAtlasTex );
+	glTexEnvf( GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE );
+	glEnable( GL_BLEND );
+	glBlendFunc( GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA );
+
+	glMatrixMode( GL_PROJECTION );
+	glPushMatrix( );
+	glLoadIdentity( );
+	gluOrtho2D( 0., (double)hs->viewport, 0., (double)hs->viewport );
+	glMatrixMode( GL_MODELVIEW );
+	glPushMatrix( );
+	glLoadIdentity( );
+
+	glPushClientAttrib( GL_CLIENT_VERTEX_ARRAY_BIT );
+	glEnableClientState( GL_VERTEX_ARRAY );
+	glEnableClientState( GL_TEXTURE_COORD_ARRAY );
+	glVertexPointer( 2, GL_FLOAT, 0, hs->verts );
+	glTexCoordPointer( 2, GL_FLOAT, 0, hs->texcoords );
+	glDrawArrays( GL_QUADS, 0, hs->numVerts );
+	glPopClientAttrib( );
+
+	glMatrixMode( GL_PROJECTION );
+	glPopMatrix( );
+	glMatrixMode( GL_MODELVIEW );
+	glPopMatrix( );
+	glPopAttrib( );
+}
@@ -0,0 +1,335 @@
+#include <stdio.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <vector>
+
+// work-stealing job system:
+//
+//	JobsStart( ) starts a worker thread per extra core; each thread, the main thread included,
+//	has its own deque of jobs
+//	a thread pushes and pops at the back of its own deque (newest first, still warm in the cache)
+//	and, when that is empty, steals from the front of someone else's (oldest, usually the biggest)
+//	every job belongs to a JobCounter that counts its unfinished jobs; JobWait( ) runs other jobs
+//	while it waits instead of blocking, so waiting from inside a job can't deadlock
+//	on top of that:
+//		ParallelFor( )		splits [0,n) into ranges and runs them as jobs
+//		JobGraph			jobs with dependencies, each started once everything it depends on is done
+//	jobs must not call OpenGL -- only the main thread has the context
+//	each thread also gets an Arena, for ParallelFor( )'s ranges and, in the render job system,
+//	as its frame arena
+//	(this comes after trace.cpp, so the workers can name their trace tracks, and arena.cpp)
+
+#define JOB_ARENA_BYTES		ARENA_GRANULE
+
+typedef std::atomic<int> JobCounter;
+typedef void (*JobFunc)( void *data );
+
+struct Job
+{
+	JobFunc		func;
+	void		*data;
+	JobCounter	*counter;
+};
+
+struct JobQueue
+{
+	std::mutex			lock;
+	std::deque<struct Job>	jobs;
+};
+
+struct JobSystem
+{
+	int					numThreads;		// workers + the main thread
+	struct JobQueue		*queues;		// queues[0] is the main thread's
+	struct Arena		*arenas;		// one per thread, the same way
+	std::vector<std::thread>	workers;
+	std::atomic<int>	queued;			// jobs sitting in any queue
+	std::atomic<bool>	quit;
+	std::mutex			sleepLock;		// idle workers sleep on wake
+	std::condition_variable	wake;
+};
+
+static bool
+JobPop( struct JobSystem *js, struct Job *job )
+{
+	// our own newest job first:
+	struct JobQueue *q = &js->queues[ JobThreadIndex ];
+	{
+		std::lock_guard<std::mutex> guard( q->lock );
+		if( ! q->jobs.empty( ) )
+		{
+			*job = q->jobs.back( );
+			q->jobs.pop_back( );
+			js->queued--;
+			return true;
+		}
+	}
+
+	// then steal the oldest job from the others, starting with our neighbor:
+	for( int k = 1; k < js->numThreads; k++ )
+	{
+		struct JobQueue *victim = &js->queues[ ( JobThreadIndex + k ) % js->numThreads ];
+		std::lock_guard<std::mutex> guard( victim->lock );
+		if( ! victim->jobs.empty( ) )
+		{
+			*job = victim->jobs.front( );
+			victim->jobs.pop_front( );
+			js->queued--;
+			return true;
+		}
+	}
+	return false;
+}
+
+
+static void
+JobExecute( struct Job *job )
+{
+	job->func( job->data );
+	job->counter->fetch_sub( 1 );
+}
+
+
+static void
+JobWorker( struct JobSystem *js, int index )
+{
+	JobThreadIndex = index;
+	TRACE_THREAD_NAME( "job worker" );
+	while( ! js->quit )
+	{
+		struct Job job;
+		if( JobPop( js, &job ) )
+		{
+			JobExecute( &job );
+			continue;
+		}
+
+		std::unique_lock<std::mutex> guard( js->sleepLock );
+		js->wake.wait( guard, [js] { return js->queued > 0  ||  js->quit; } );
+	}
+}
+
+
+// start numThreads-1 workers (numThreads <= 0 means one per core):
+
+void
+JobsStart( struct JobSystem *js, int numThreads )
+{
+	if( numThreads <= 0 )
+		numThreads = (int)std::thread::hardware_concurrency( );
+	if( numThreads < 1 )
+		numThreads = 1;
+
+	js->numThreads = numThreads;
+	js->queues = new struct JobQueue[ numThreads ];
+	js->arenas = new struct Arena[ numThreads ];
+	for( int i = 0; i < numThreads; i++ )
+		ArenaInit( &js->arenas[i], JOB_ARENA_BYTES );
+	js->queued = 0;
+	js->quit = false;
+	JobThreadIndex = 0;
+	for( int i = 1; i < numThreads; i++ )
+		js->workers.push_back( std::thread( JobWorker, js, i ) );
+}
+
+
+void
+JobsStop( struct JobSystem *js )
+{
+	{
+		std::lock_guard<std::mutex> guard( js->sleepLock );
+		js->quit = true;
+	}
+	js->wake.notify_all( );
+	for( unsigned int i = 0; i < js->workers.size( ); i++ )
+		js->workers[i].join( );
+	js->workers.clear( );
+	delete [ ] js->queues;
+	js->queues = NULL;
+	for( int i = 0; i < js->numThreads; i++ )
+		ArenaFree( &js->arenas[i] );
+	delete [ ] js->arenas;
+	js->arenas = NULL;
+}
+
+
+// queue func(data) on this thread's deque, counted in *counter:
+
+void
+JobRun( struct JobSystem *js, JobFunc func, void *data, JobCounter *counter )
+{
+	counter->fetch_add( 1 );
+	struct Job job = { func, data, counter };
+	struct JobQueue *q = &js->queues[ JobThreadIndex ];
+	{
+		std::lock_guard<std::mutex> guard( q->lock );
+		q->jobs.push_back( job );
+	}
+	js->queued++;
+
+	if( js->numThreads > 1 )
+	{
+		// take the lock so a worker can't check queued and then miss this notify:
+		std::lock_guard<std::mutex> guard( js->sleepLock );
+		js->wake.notify_one( );
+	}
+}
+
+
+// run jobs until every job counted in *counter has finished:
+
+void
+JobWait( struct JobSystem *js, JobCounter *counter )
+{
+	while( *counter > 0 )
+	{
+		struct Job job;
+		if( JobPop( js, &job ) )
+			JobExecute( &job );
+		else
+			std::this_thread::yield( );		// the last ones are running on other threads
+	}
+}
+
+
+// parallel for:
+
+typedef void (*RangeFunc)( void *data, int first, int last );
+
+struct RangeJob
+{
+	RangeFunc	func;
+	void		*data;
+	int			first, last;
+};
+
+static void
+RangeJobRun( void *data )
+{
+	struct RangeJob *r = (struct RangeJob *)data;
+	r->func( r->data, r->first, r->last );
+}
+
+
+// call func(data, first, last) over [0,n) in ranges of about grain, on every thread,
+// and return once all of them are done:
+
+void
+ParallelFor( struct JobSystem *js, int n, int grain, RangeFunc func, void *data )
+{
+	if( grain < 1 )
+		grain = 1;
+	int numRanges = ( n + grain - 1 ) / grain;
+	if( js->numThreads <= 1  ||  numRanges <= 1 )
+	{
+		if( n > 0 )
+			func( data, 0, n );
+		return;
+	}
+
+	// the ranges only have to last until they are all done, so they come from this thread's arena:
+	struct Arena *arena = &js->arenas[ JobThreadIndex ];
+	struct ArenaMarker mark = ArenaMark( arena );
+	struct RangeJob *ranges = (struct RangeJob *)ArenaAlloc( arena, numRanges * sizeof(struct RangeJob) );
+	JobCounter counter( 0 );
+	for( int r = 0; r < numRanges; r++ )
+	{
+		ranges[r].func  = func;
+		ranges[r].data  = data;
+		ranges[r].first = r * grain;
+		ranges[r].last  = r * grain + grain < n ? r * grain + grain : n;
+		if( r > 0 )
+			JobRun( js, RangeJobRun, &ranges[r], &counter );
+	}
+	RangeJobRun( &ranges[0] );		// this thread takes the first range itself
+	JobWait( js, &counter );
+	ArenaRelease( arena, mark );
+}
+
+
+// task graph:
+//	add the jobs with JobGraphAdd( ), say which must finish before which with JobGraphDepend( ),
+//	then JobGraphRun( ) starts the ones with nothing to wait for and returns when all are done
+//	a graph can be run again every frame; the edges are kept
+
+struct JobGraphNode
+{
+	JobFunc		func;
+	void		*data;
+	int			numDepends;				// how many nodes must finish first
+	std::atomic<int>	remaining;		// of those, how many haven't yet, this run
+	std::vector<int>	next;			// nodes that depend on this one
+	struct JobGraph		*graph;
+};
+
+struct JobGraph
+{
+	struct JobSystem	*js;
+	std::deque<struct JobGraphNode>	nodes;		// a deque so adding doesn't move the atomics
+	JobCounter		counter;
+};
+
+
+void
+JobGraphInit( struct JobGraph *g, struct JobSystem *js )
+{
+	g->js = js;
+	g->nodes.clear( );
+	g->counter = 0;
+}
+
+
+int
+JobGraphAdd( struct JobGraph *g, JobFunc func, void *data )
+{
+	g->nodes.emplace_back( );
+	struct JobGraphNode *node = &g->nodes.back( );
+	node->func = func;
+	node->data = data;
+	node->numDepends = 0;
+	node->remaining = 0;
+	node->graph = g;
+	return (int)g->nodes.size( ) - 1;
+}
+
+
+// node `after' waits for node `before':
+
+void
+JobGraphDepend( struct JobGraph *g, int before, int after )
+{
+	g->nodes[before].next.push_back( after );
+	g->nodes[after].numDepends++;
+}
+
+
+static void
+JobGraphNodeRun( void *data )
+{
+	struct JobGraphNode *node = (struct JobGraphNode *)data;
+	node->func( node->data );
+
+	// release whatever was only waiting for us:
+	struct JobGraph *g = node->graph;
+	for( unsigned int k = 0; k < node->next.size( ); k++ )
+	{
+		struct JobGraphNode *n = &g->nodes[ node->next[k] ];
+		if( n->remaining.fetch_sub( 1 ) == 1 )
+			JobRun( g->js, JobGraphNodeRun, n, &g->counter );
+	}
+}
+
+
+void
+JobGraphRun( struct JobGraph *g )
+{
+	for( unsigned int i = 0; i < g->nodes.size( ); i++ )
+		g->nodes[i].remaining = g->nodes[i].numDepends;
+	for( unsigned int i = 0; i < g->nodes.size( ); i++ )
+		if( g->nodes[i].numDepends == 0 )
+			JobRun( g->js, JobGraphNodeRun, &g->nodes[i], &g->counter );
+	JobWait( g->js, &g->counter );
+}
@@ -0,0 +1,246 @@
+#include <stdio.h>
+#include <chrono>
+
+// input-to-photon latency:
+//
+//	every input the user makes is stamped and followed through four stages:
+//		tick	LatencyInput( ) when it is queued, to the simulation tick popping it off the queue
+//		frame	to the frame that picked that tick's snapshot up (LatencyPickup( ))
+//		swap	to glutSwapBuffers( ) returning for that frame (LatencySwapped( ))
+//		gpu		to the gpu finishing that frame, seen through a fence (LatencyPoll( ))
+//	and the whole of it, input to photon -- as close as we can get without a camera: the
+//	display's scan-out comes after
+//	each stage keeps a histogram; LatencyReport( ) prints them
+//	without ARB_sync there is no fence, and the gpu stage is taken as zero
+//
+//	inputs are numbered in the order they are queued; the simulation counts the ones it has
+//	applied, stamps when it popped each, and puts the count and the newest LATENCY_APPLIED stamps
+//	in each snapshot, so the snapshots are all that needs to cross threads -- everything here
+//	runs on the main thread
+
+#define LATENCY_RING		256			// inputs that can be in flight at once
+#define LATENCY_FENCES		8			// frames that can be waiting on the gpu at once
+#define LATENCY_APPLIED		16			// inputs whose apply times a snapshot carries
+
+#define LAT_TICK			0
+#define LAT_FRAME			1
+#define LAT_SWAP			2
+#define LAT_GPU				3
+#define LAT_TOTAL			4
+#define NUM_LAT_STAGES		5
+
+#define NUM_LAT_BUCKETS		16
+
+static const char *	LatencyStageNames[NUM_LAT_STAGES] = { "input to tick", "tick to frame", "frame to swap", "swap to gpu", "input to photon" };
+static const double	LatencyBucketMS[NUM_LAT_BUCKETS] = { 1., 2., 4., 8., 12., 16., 24., 33., 50., 67., 100., 150., 250., 500., 1000., 1.e30 };
+
+struct LatencyHistogram
+{
+	int		counts[NUM_LAT_BUCKETS];		// counts[b] is <= LatencyBucketMS[b] and > the one before
+	int		n;
+	double	sumMS, maxMS;
+};
+
+struct LatencyEvent
+{
+	std::chrono::steady_clock::time_point	input, applied, picked, swapped;
+};
+
+struct LatencyFence
+{
+	GLsync	sync;
+	int		lastSeq;					// the newest input this frame showed
+};
+
+struct LatencyEvent		LatencyEvents[LATENCY_RING];		// input seq is in LatencyEvents[ seq % LATENCY_RING ]
+struct LatencyHistogram	LatencyStages[NUM_LAT_STAGES];
+struct LatencyFence		LatencyFences[LATENCY_FENCES];		// oldest first
+int		NumLatencyFences;
+int		LatencyQueuedSeq;				// inputs queued so far
+int		LatencyPickedSeq;				// inputs shown in a frame that has been built
+int		LatencyFencedSeq;				// inputs shown in a frame that has been swapped
+int		LatencyDoneSeq;					// inputs whose frame the gpu has finished
+
+
+static double
+LatencyMS( std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to )
+{
+	double ms = std::chrono::duration<double, std::milli>( to - from ).count( );
+	return ms > 0. ? ms : 0.;
+}
+
+
+static void
+LatencyAdd( int stage, double ms )
+{
+	struct LatencyHistogram *h = &LatencyStages[stage];
+	int b = 0;
+	while( ms > LatencyBucketMS[b] )
+		b++;
+	h->counts[b]++;
+	h->n++;
+	h->sumMS += ms;
+	if( ms > h->maxMS )
+		h->maxMS = ms;
+}
+
+
+// the latency below which fraction p of the samples fall, interpolated within its bucket:
+
+double
+LatencyPercentile( const struct LatencyHistogram *h, double p )
+{
+	if( h->n == 0 )
+		return 0.;
+	double want = p * h->n;
+	int seen = 0;
+	for( int b = 0; b < NUM_LAT_BUCKETS; b++ )
+	{
+		if( h->counts[b] == 0 )
+			continue;
+		if( seen + h->counts[b] >= want )
+		{
+			double lo = b == 0 ? 0. : LatencyBucketMS[b-1];
+			double hi = LatencyBucketMS[b] < h->maxMS ? LatencyBucketMS[b] : h->maxMS;
+			double ms = lo + ( hi - lo ) * ( want - seen ) / h->counts[b];
+			return ms > lo ? ms : lo;
+		}
+		seen += h->counts[b];
+	}
+	return h->maxMS;
+}
+
+
+// an input was just queued for the simulation:
+
+void
+LatencyInput( )
+{
+	if( LatencyQueuedSeq - LatencyDoneSeq >= LATENCY_RING )
+		LatencyDoneSeq++;			// so many in flight that the oldest would be overwritten: forget it
+	LatencyEvents[ LatencyQueuedSeq % LATENCY_RING ].input = std::chrono::steady_clock::now( );
+	LatencyQueuedSeq++;
+}
+
+
+// the frame being built shows a snapshot that has applied appliedSeq inputs, input seq at
+// appliedAt[ seq % LATENCY_APPLIED ] for the newest LATENCY_APPLIED of them, published at published
+// (which stands in for the apply time of any older ones it picks up, after a long stall):
+
+void
+LatencyPickup( int appliedSeq, const std::chrono::steady_clock::time_point *appliedAt, std::chrono::steady_clock::time_point published )
+{
+	if( appliedSeq > LatencyQueuedSeq )
+		appliedSeq = LatencyQueuedSeq;
+	if( LatencyPickedSeq < LatencyDoneSeq )
+		LatencyPickedSeq = LatencyDoneSeq;
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now( );
+	for( ; LatencyPickedSeq < appliedSeq; LatencyPickedSeq++ )
+	{
+		struct LatencyEvent *e = &LatencyEvents[ LatencyPickedSeq % LATENCY_RING ];
+		e->applied = appliedSeq - LatencyPickedSeq <= LATENCY_APPLIED ? appliedAt[ LatencyPickedSeq % LATENCY_APPLIED ] : published;
+		e->picked = now;
+	}
+}
+
+
+static void
+LatencyFinish( int lastSeq )
+{
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now( );
+	if( LatencyDoneSeq < LatencyQueuedSeq - LATENCY_RING )
+		LatencyDoneSeq = LatencyQueuedSeq - LATENCY_RING;
+	for( ; LatencyDoneSeq < lastSeq; LatencyDoneSeq++ )
+	{
+		const struct LatencyEvent *e = &LatencyEvents[ LatencyDoneSeq % LATENCY_RING ];
+		LatencyAdd( LAT_TICK,  LatencyMS( e->input,   e->applied ) );
+		LatencyAdd( LAT_FRAME, LatencyMS( e->applied, e->picked ) );
+		LatencyAdd( LAT_SWAP,  LatencyMS( e->picked,  e->swapped ) );
+		LatencyAdd( LAT_GPU,   LatencyMS( e->swapped, now ) );
+		LatencyAdd( LAT_TOTAL, LatencyMS( e->input,   now ) );
+	}
+}
+
+
+// glutSwapBuffers( ) just returned for the frame that LatencyPickup( ) was told about:
+
+void
+LatencySwapped( )
+{
+	if( LatencyPickedSeq <= LatencyFencedSeq )
+		return;
+	if( NumLatencyFences == LATENCY_FENCES )
+		return;				// the gpu is far behind; these inputs wait for the next frame's fence
+
+	if( LatencyFencedSeq < LatencyDoneSeq )
+		LatencyFencedSeq = LatencyDoneSeq;
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now( );
+	for( int seq = LatencyFencedSeq; seq < LatencyPickedSeq; seq++ )
+		LatencyEvents[ seq % LATENCY_RING ].swapped = now;
+	LatencyFencedSeq = LatencyPickedSeq;
+
+	if( ! GLEW_ARB_sync )
+	{
+		LatencyFinish( LatencyFencedSeq );
+		return;
+	}
+	struct LatencyFence *f = &LatencyFences[ NumLatencyFences++ ];
+	f->sync = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+	f->lastSeq = LatencyFencedSeq;
+	glFlush( );				// so the fence gets to the gpu even if no more frames come
+}
+
+
+// retire the frames the gpu has finished, returning true while some are still waiting:
+// call with the gl context current
+
+bool
+LatencyPoll( )
+{
+	while( NumLatencyFences > 0 )
+	{
+		GLenum r = glClientWaitSync( LatencyFences[0].sync, 0, 0 );
+		if( r == GL_TIMEOUT_EXPIRED )
+			return true;
+		glDeleteSync( LatencyFences[0].sync );
+		LatencyFinish( LatencyFences[0].lastSeq );
+		NumLatencyFences--;
+		for( int i = 0; i < NumLatencyFences; i++ )
+			LatencyFences[i] = LatencyFences[i+1];
+	}
+	return false;
+}
+
+
+void
+LatencyReport( FILE *fp )
+{
+	fprintf( fp, "%-16s %6s %8s %8s %8s %8s %8s\n", "latency (ms)", "n", "mean", "p50", "p90", "p99", "max" );
+	for( int s = 0; s < NUM_LAT_STAGES; s++ )
+	{
+		const struct LatencyHistogram *h = &LatencyStages[s];
+		fprintf( fp, "%-16s %6d %8.2f %8.2f %8.2f %8.2f %8.2f\n", LatencyStageNames[s], h->n,
+			h->n > 0 ? h->sumMS / h->n : 0., LatencyPercentile( h, .5 ), LatencyPercentile( h, .9 ),
+			LatencyPercentile( h, .99 ), h->maxMS );
+	}
+
+	// and the whole distribution of the total:
+	const struct LatencyHistogram *t = &LatencyStages[LAT_TOTAL];
+	if( t->n == 0 )
+		return;
+	for( int b = 0; b < NUM_LAT_BUCKETS; b++ )
+	{
+		if( t->counts[b] == 0 )
+			continue;
+		char label[ 32 ];
+		if( b == NUM_LAT_BUCKETS - 1 )
+			sprintf( label, "> %g ms", LatencyBucketMS[b-1] );
+		else
+			sprintf( label, "<= %g ms", LatencyBucketMS[b] );
+		fprintf( fp, "  %-12s %6d  ", label, t->counts[b] );
+		int bar = ( 50 * t->counts[b] + t->n - 1 ) / t->n;
+		for( int i = 0; i < bar; i++ )
+			fputc( '#', fp );
+		fputc( '\n', fp );
+	}
+}
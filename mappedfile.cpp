@@ -0,0 +1,96 @@
+#include <stdio.h>
+#include <string.h>
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+// read-only memory-mapped files, for the binary caches that are used in place
+// rather than parsed (the chebyshev ephemeris and the compiled system description)
+
+struct MappedFile
+{
+	void	*base;		// NULL if nothing is mapped
+	size_t	size;
+#ifdef WIN32
+	HANDLE	file, mapping;
+#endif
+};
+
+
+// release a mapping (harmless if nothing is mapped):
+
+void
+UnmapFile( struct MappedFile *mf )
+{
+	if( mf->base != NULL )
+	{
+#ifdef WIN32
+		UnmapViewOfFile( mf->base );
+		CloseHandle( mf->mapping );
+		CloseHandle( mf->file );
+#else
+		munmap( mf->base, mf->size );
+#endif
+	}
+	memset( mf, 0, sizeof(*mf) );
+}
+
+
+// map a whole file read-only:
+// returns false, with mf->base NULL, if it can't be opened or mapped
+
+bool
+MapFile( struct MappedFile *mf, const char *filename )
+{
+	memset( mf, 0, sizeof(*mf) );
+
+#ifdef WIN32
+	mf->file = CreateFileA( filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+	if( mf->file == INVALID_HANDLE_VALUE )
+	{
+		fprintf( stderr, "Cannot open '%s'\n", filename );
+		return false;
+	}
+	mf->size = (size_t)GetFileSize( mf->file, NULL );
+	mf->mapping = CreateFileMappingA( mf->file, NULL, PAGE_READONLY, 0, 0, NULL );
+	if( mf->mapping != NULL )
+		mf->base = MapViewOfFile( mf->mapping, FILE_MAP_READ, 0, 0, 0 );
+	if( mf->base == NULL )
+	{
+		fprintf( stderr, "Cannot map '%s'\n", filename );
+		if( mf->mapping != NULL )
+			CloseHandle( mf->mapping );
+		CloseHandle( mf->file );
+		memset( mf, 0, sizeof(*mf) );
+		return false;
+	}
+#else
+	int fd = open( filename, O_RDONLY );
+	if( fd < 0 )
+	{
+		fprintf( stderr, "Cannot open '%s'\n", filename );
+		return false;
+	}
+	struct stat st;
+	if( fstat( fd, &st ) == 0  &&  st.st_size > 0 )
+	{
+		mf->size = (size_t)st.st_size;
+		mf->base = mmap( NULL, mf->size, PROT_READ, MAP_PRIVATE, fd, 0 );
+	}
+	close( fd );		// the mapping keeps the file alive
+	if( mf->base == NULL  ||  mf->base == MAP_FAILED )
+	{
+		fprintf( stderr, "Cannot map '%s'\n", filename );
+		memset( mf, 0, sizeof(*mf) );
+		return false;
+	}
+#endif
+
+	return true;
+}
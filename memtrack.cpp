@@ -0,0 +1,171 @@
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+
+#ifdef WIN32
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#endif
+
+// memory accounting by subsystem:
+//
+//	the places that allocate anything big say so with MemAdd( ) / MemSub( ) against a tag;
+//	each tag keeps its current and peak bytes (atomically -- jobs allocate too)
+//	the gpu tags are estimates of what the driver holds, and aren't in the process's rss
+//	MemCheck( ) compares the cpu tags against the process's resident set size: whatever the
+//	rss has grown by beyond what the tags account for is untracked, and steady growth there
+//	is a leak (a gluNewQuadric( ) a frame shows up within seconds)
+//	MemReport( ) prints the table, MemReportJson( ) adds it to a benchmark's json
+
+#define MEM_TEXTURES		0		// decoded texels still in cpu memory
+#define MEM_TEXTURES_GPU	1		// texture storage, estimated
+#define MEM_BUFFERS_GPU		2		// vertex buffers
+#define MEM_MESHES			3		// geometry and particles kept between frames (the belts)
+#define MEM_STARS			4
+#define MEM_SCRATCH			5		// the frame arenas
+#define MEM_OTHER			6		// bodies, ephemeris, scene graph, bvh, ...
+#define NUM_MEM_TAGS		7
+
+#define MEM_CHECK_MS		1000.				// how often MemCheck( ) reads the rss
+#define MEM_LEAK_STEP		(8*1024*1024)		// complain each time untracked memory grows by this much
+
+static const char *	MemTagNames[NUM_MEM_TAGS] = { "textures", "textures-gpu", "buffers-gpu", "meshes", "stars", "scratch", "other" };
+static const bool	MemTagGpu[NUM_MEM_TAGS]   = { false,      true,           true,          false,    false,   false,     false };
+
+std::atomic<long long>	MemCurrent[NUM_MEM_TAGS];
+std::atomic<long long>	MemPeak[NUM_MEM_TAGS];
+
+long long	MemRss;					// the last rss MemCheck( ) read, 0 if it can't be read here
+long long	MemUntracked;			// the part of that the cpu tags don't account for
+long long	MemUntrackedBase = -1;	// MemUntracked at the first check, once startup was done
+long long	MemLeakReported;		// growth past the base already complained about
+std::chrono::steady_clock::time_point	MemLastCheck;
+
+
+void
+MemAdd( int tag, long long bytes )
+{
+	long long now = MemCurrent[tag].fetch_add( bytes ) + bytes;
+	long long peak = MemPeak[tag].load( );
+	while( now > peak  &&  ! MemPeak[tag].compare_exchange_weak( peak, now ) )
+		;
+}
+
+
+inline
+void
+MemSub( int tag, long long bytes )
+{
+	MemCurrent[tag].fetch_sub( bytes );
+}
+
+
+// the bytes the cpu tags account for right now:
+
+long long
+MemTrackedCpu( )
+{
+	long long sum = 0;
+	for( int t = 0; t < NUM_MEM_TAGS; t++ )
+		if( ! MemTagGpu[t] )
+			sum += MemCurrent[t];
+	return sum;
+}
+
+
+// the process's resident set size in bytes, 0 if we can't tell:
+
+long long
+MemProcessRss( )
+{
+#ifdef WIN32
+	PROCESS_MEMORY_COUNTERS pmc;
+	if( GetProcessMemoryInfo( GetCurrentProcess( ), &pmc, sizeof(pmc) ) )
+		return (long long)pmc.WorkingSetSize;
+	return 0;
+#else
+	FILE *fp = fopen( "/proc/self/status", "r" );
+	if( fp == NULL )
+		return 0;
+	char line[ 256 ];
+	long long kb = 0;
+	while( fgets( line, sizeof(line), fp ) != NULL )
+	{
+		if( strncmp( line, "VmRSS:", 6 ) == 0 )
+		{
+			sscanf( line + 6, "%lld", &kb );
+			break;
+		}
+	}
+	fclose( fp );
+	return kb * 1024;
+#endif
+}
+
+
+// read the rss and compare it with the tags, now or when MEM_CHECK_MS has gone by since last time:
+// warns on stderr each time the untracked part has grown by another MEM_LEAK_STEP
+
+void
+MemCheck( bool now )
+{
+	std::chrono::steady_clock::time_point t = std::chrono::steady_clock::now( );
+	if( ! now  &&  MemUntrackedBase >= 0  &&
+		std::chrono::duration<double, std::milli>( t - MemLastCheck ).count( ) < MEM_CHECK_MS )
+		return;
+	MemLastCheck = t;
+
+	MemRss = MemProcessRss( );
+	if( MemRss == 0 )
+		return;
+	MemUntracked = MemRss - MemTrackedCpu( );
+	if( MemUntrackedBase < 0 )
+	{
+		MemUntrackedBase = MemUntracked;
+		return;
+	}
+
+	long long growth = MemUntracked - MemUntrackedBase;
+	if( growth >= MemLeakReported + MEM_LEAK_STEP )
+	{
+		MemLeakReported = growth - growth % MEM_LEAK_STEP;
+		fprintf( stderr, "Memory: rss has grown %.1f MB beyond what is tracked since startup -- a leak?\n",
+			growth / ( 1024. * 1024. ) );
+	}
+}
+
+
+void
+MemReport( FILE *fp )
+{
+	MemCheck( true );
+	fprintf( fp, "%-14s %10s %10s\n", "memory (MB)", "current", "peak" );
+	for( int t = 0; t < NUM_MEM_TAGS; t++ )
+		fprintf( fp, "%-14s %10.2f %10.2f\n", MemTagNames[t], MemCurrent[t] / ( 1024. * 1024. ), MemPeak[t] / ( 1024. * 1024. ) );
+	fprintf( fp, "%-14s %10.2f\n", "tracked cpu", MemTrackedCpu( ) / ( 1024. * 1024. ) );
+	if( MemRss > 0 )
+	{
+		fprintf( fp, "%-14s %10.2f\n", "rss", MemRss / ( 1024. * 1024. ) );
+		fprintf( fp, "%-14s %10.2f\n", "untracked", MemUntracked / ( 1024. * 1024. ) );
+	}
+}
+
+
+// write  "memory": { ... }  with no comma or newline after it, each line starting with indent:
+
+void
+MemReportJson( FILE *fp, const char *indent )
+{
+	MemCheck( true );
+	fprintf( fp, "%s\"memory\": {\n", indent );
+	fprintf( fp, "%s  \"rss\": %lld,\n", indent, MemRss );
+	fprintf( fp, "%s  \"tracked_cpu\": %lld,\n", indent, MemTrackedCpu( ) );
+	fprintf( fp, "%s  \"tags\": {\n", indent );
+	for( int t = 0; t < NUM_MEM_TAGS; t++ )
+		fprintf( fp, "%s    \"%s\": { \"current\": %lld, \"peak\": %lld }%s\n", indent, MemTagNames[t],
+			MemCurrent[t].load( ), MemPeak[t].load( ), t == NUM_MEM_TAGS - 1 ? "" : "," );
+	fprintf( fp, "%s  }\n", indent );
+	fprintf( fp, "%s}", indent );
+}
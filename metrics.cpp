@@ -0,0 +1,332 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <atomic>
+#include <thread>
+#include <chrono>
+
+#ifndef WIN32
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#endif
+
+// live metrics over a unix-domain socket, in prometheus text format:
+//
+//	MetricsStart( path ) listens on path with a thread of its own; each connection gets the
+//	current metrics and is closed -- an http GET gets an http response, so
+//		curl --unix-socket path http://localhost/metrics
+//	works, as does anything that speaks prometheus through a socket proxy; anything else just
+//	gets the text
+//	the render thread publishes into the atomics below once a frame (MetricsFrame( ) and
+//	friends) and the server only ever loads them, so a scrape can't hold up a frame
+//	(not on windows, for now)
+
+#define NUM_METRIC_BUCKETS		9
+static const double	MetricBucketSeconds[NUM_METRIC_BUCKETS] = { .004, .008, .0125, .0167, .025, .0333, .05, .1, .25 };
+
+#define METRIC_DRAWN_BODIES		0
+#define METRIC_DRAWN_PARTS		1
+#define METRIC_DRAWN_STARS		2
+#define METRIC_DRAWN_CHUNKS		3
+#define METRIC_DRAWN_CLUSTERS	4
+#define NUM_METRIC_DRAWN		5
+static const char *	MetricDrawnNames[NUM_METRIC_DRAWN] = { "bodies", "ship_parts", "stars", "star_chunks", "belt_clusters" };
+
+struct MetricHistogram
+{
+	std::atomic<long long>	counts[NUM_METRIC_BUCKETS + 1];		// not cumulative; the last is +Inf
+	std::atomic<long long>	sumMicroseconds;
+};
+
+struct Metrics
+{
+	std::atomic<long long>	frames;
+	struct MetricHistogram	frameInterval;		// swap to swap
+	struct MetricHistogram	displayTime;		// Display( ) start to swap
+	std::atomic<double>		fps;				// frames in the last whole second
+	std::atomic<int>		drawn[NUM_METRIC_DRAWN], total[NUM_METRIC_DRAWN];
+	std::atomic<int>		textures;			// texture objects loaded
+	std::atomic<double>		travel, velocity, lightSpeedMultiple;
+	std::atomic<long long>	scrapes;
+};
+
+struct Metrics	TheMetrics;
+bool			MetricsOn;
+const char *	MetricsPath;
+std::thread		MetricsThread;
+std::atomic<bool>	MetricsQuit;
+int				MetricsSocket = -1;
+
+std::chrono::steady_clock::time_point	MetricsLastSwap, MetricsSecondStart;
+long long		MetricsSecondFrames;
+
+
+static void
+MetricsObserve( struct MetricHistogram *h, double seconds )
+{
+	int b = 0;
+	while( b < NUM_METRIC_BUCKETS  &&  seconds > MetricBucketSeconds[b] )
+		b++;
+	h->counts[b].fetch_add( 1, std::memory_order_relaxed );
+	h->sumMicroseconds.fetch_add( (long long)( seconds * 1.e6 ), std::memory_order_relaxed );
+}
+
+
+// a frame was just swapped; it started at displayStart:
+
+void
+MetricsFrame( std::chrono::steady_clock::time_point displayStart )
+{
+	if( ! MetricsOn )
+		return;
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now( );
+	if( TheMetrics.frames.load( std::memory_order_relaxed ) > 0 )
+		MetricsObserve( &TheMetrics.frameInterval, std::chrono::duration<double>( now - MetricsLastSwap ).count( ) );
+	else
+		MetricsSecondStart = now;
+	MetricsObserve( &TheMetrics.displayTime, std::chrono::duration<double>( now - displayStart ).count( ) );
+	MetricsLastSwap = now;
+	TheMetrics.frames.fetch_add( 1, std::memory_order_relaxed );
+
+	MetricsSecondFrames++;
+	double elapsed = std::chrono::duration<double>( now - MetricsSecondStart ).count( );
+	if( elapsed >= 1. )
+	{
+		TheMetrics.fps.store( MetricsSecondFrames / elapsed, std::memory_order_relaxed );
+		MetricsSecondFrames = 0;
+		MetricsSecondStart = now;
+	}
+}
+
+
+inline
+void
+MetricsDrawn( int which, int drawn, int total )
+{
+	TheMetrics.drawn[which].store( drawn, std::memory_order_relaxed );
+	TheMetrics.total[which].store( total, std::memory_order_relaxed );
+}
+
+
+inline
+void
+MetricsShip( double travel, double velocity, double lightSpeedMultiple )
+{
+	TheMetrics.travel.store( travel, std::memory_order_relaxed );
+	TheMetrics.velocity.store( velocity, std::memory_order_relaxed );
+	TheMetrics.lightSpeedMultiple.store( lightSpeedMultiple, std::memory_order_relaxed );
+}
+
+
+// appending to a fixed buffer, quietly stopping at the end:
+
+struct MetricsText
+{
+	char	buf[ 16*1024 ];
+	int		len;
+};
+
+static void
+MetricsPrintf( struct MetricsText *t, const char *format, ... )
+{
+	va_list args;
+	va_start( args, format );
+	int room = (int)sizeof(t->buf) - t->len;
+	int n = room > 0 ? vsnprintf( t->buf + t->len, room, format, args ) : 0;
+	va_end( args );
+	if( n > 0 )
+		t->len += n < room ? n : room - 1;
+}
+
+
+static void
+MetricsHeader( struct MetricsText *t, const char *name, const char *type, const char *help )
+{
+	MetricsPrintf( t, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type );
+}
+
+
+static void
+MetricsHistogramText( struct MetricsText *t, const char *name, const char *help, const struct MetricHistogram *h )
+{
+	MetricsHeader( t, name, "histogram", help );
+	long long cumulative = 0;
+	for( int b = 0; b < NUM_METRIC_BUCKETS; b++ )
+	{
+		cumulative += h->counts[b].load( std::memory_order_relaxed );
+		MetricsPrintf( t, "%s_bucket{le=\"%g\"} %lld\n", name, MetricBucketSeconds[b], cumulative );
+	}
+	cumulative += h->counts[NUM_METRIC_BUCKETS].load( std::memory_order_relaxed );
+	MetricsPrintf( t, "%s_bucket{le=\"+Inf\"} %lld\n", name, cumulative );
+	MetricsPrintf( t, "%s_sum %.6f\n", name, h->sumMicroseconds.load( std::memory_order_relaxed ) / 1.e6 );
+	MetricsPrintf( t, "%s_count %lld\n", name, cumulative );
+}
+
+
+void
+MetricsFormat( struct MetricsText *t )
+{
+	t->len = 0;
+	t->buf[0] = '\0';
+	struct Metrics *m = &TheMetrics;
+
+	MetricsHeader( t, "ftl_frames_total", "counter", "Frames drawn." );
+	MetricsPrintf( t, "ftl_frames_total %lld\n", m->frames.load( ) );
+	MetricsHistogramText( t, "ftl_frame_interval_seconds", "Time from one buffer swap to the next.", &m->frameInterval );
+	MetricsHistogramText( t, "ftl_display_seconds", "Time from the start of Display() to its buffer swap.", &m->displayTime );
+	MetricsHeader( t, "ftl_fps", "gauge", "Frames per second over the last whole second." );
+	MetricsPrintf( t, "ftl_fps %.2f\n", m->fps.load( ) );
+
+	MetricsHeader( t, "ftl_drawn", "gauge", "Objects drawn in the last frame, after culling." );
+	for( int k = 0; k < NUM_METRIC_DRAWN; k++ )
+		MetricsPrintf( t, "ftl_drawn{what=\"%s\"} %d\n", MetricDrawnNames[k], m->drawn[k].load( ) );
+	MetricsHeader( t, "ftl_candidates", "gauge", "Objects considered for drawing in the last frame." );
+	for( int k = 0; k < NUM_METRIC_DRAWN; k++ )
+		MetricsPrintf( t, "ftl_candidates{what=\"%s\"} %d\n", MetricDrawnNames[k], m->total[k].load( ) );
+
+	MetricsHeader( t, "ftl_resident_memory_bytes", "gauge", "The process's resident set size." );
+	MetricsPrintf( t, "ftl_resident_memory_bytes %lld\n", MemProcessRss( ) );
+	MetricsHeader( t, "ftl_memory_bytes", "gauge", "Tracked memory by subsystem (the gpu tags are estimates)." );
+	for( int k = 0; k < NUM_MEM_TAGS; k++ )
+		MetricsPrintf( t, "ftl_memory_bytes{tag=\"%s\"} %lld\n", MemTagNames[k], MemCurrent[k].load( ) );
+	MetricsHeader( t, "ftl_textures_resident", "gauge", "Texture objects loaded onto the gpu." );
+	MetricsPrintf( t, "ftl_textures_resident %d\n", m->textures.load( ) );
+
+	MetricsHeader( t, "ftl_travel_miles", "gauge", "How far the ship has come along its route." );
+	MetricsPrintf( t, "ftl_travel_miles %.0f\n", m->travel.load( ) );
+	MetricsHeader( t, "ftl_velocity", "gauge", "The ship's velocity, in the simulation's units." );
+	MetricsPrintf( t, "ftl_velocity %g\n", m->velocity.load( ) );
+	MetricsHeader( t, "ftl_light_speed_multiple", "gauge", "The ship's speed as a multiple of the speed of light." );
+	MetricsPrintf( t, "ftl_light_speed_multiple %g\n", m->lightSpeedMultiple.load( ) );
+
+	MetricsHeader( t, "ftl_scrapes_total", "counter", "Times these metrics have been read." );
+	MetricsPrintf( t, "ftl_scrapes_total %lld\n", m->scrapes.fetch_add( 1 ) + 1 );
+}
+
+
+#ifndef WIN32
+static void
+MetricsWriteAll( int fd, const char *p, int n )
+{
+	while( n > 0 )
+	{
+		ssize_t w = send( fd, p, n, MSG_NOSIGNAL );		// a client that hung up mustn't SIGPIPE us
+		if( w <= 0 )
+			return;
+		p += w;
+		n -= (int)w;
+	}
+}
+
+
+static void
+MetricsServe( int listenFd )
+{
+	struct MetricsText *text = new struct MetricsText;
+	while( ! MetricsQuit )
+	{
+		// wake up now and then to see if we should quit:
+		struct pollfd pfd = { listenFd, POLLIN, 0 };
+		if( poll( &pfd, 1, 200 ) <= 0 )
+			continue;
+		int fd = accept( listenFd, NULL, NULL );
+		if( fd < 0 )
+			continue;
+
+		// whatever the client sends first, if it sends it promptly:
+		char request[ 512 ];
+		int n = 0;
+		struct pollfd rfd = { fd, POLLIN, 0 };
+		if( poll( &rfd, 1, 100 ) > 0 )
+		{
+			ssize_t r = read( fd, request, sizeof(request) - 1 );
+			n = r > 0 ? (int)r : 0;
+		}
+		request[n] = '\0';
+
+		MetricsFormat( text );
+		if( strncmp( request, "GET ", 4 ) == 0 )
+		{
+			char header[ 160 ];
+			int h = sprintf( header, "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %d\r\nConnection: close\r\n\r\n", text->len );
+			MetricsWriteAll( fd, header, h );
+		}
+		MetricsWriteAll( fd, text->buf, text->len );
+		close( fd );
+	}
+	delete text;
+}
+#endif
+
+
+// start serving on a unix-domain socket at path, false (with a message) if we can't:
+
+bool
+MetricsStart( const char *path )
+{
+#ifdef WIN32
+	fprintf( stderr, "-metrics: unix-domain sockets aren't supported on this platform\n" );
+	return false;
+#else
+	struct sockaddr_un addr;
+	if( strlen( path ) >= sizeof(addr.sun_path) )
+	{
+		fprintf( stderr, "-metrics: socket path '%s' is too long\n", path );
+		return false;
+	}
+	int fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+	if( fd < 0 )
+	{
+		perror( "-metrics: socket" );
+		return false;
+	}
+	memset( &addr, 0, sizeof(addr) );
+	addr.sun_family = AF_UNIX;
+	strcpy( addr.sun_path, path );
+	struct stat st;
+	if( lstat( path, &st ) == 0 )
+	{
+		if( ! S_ISSOCK( st.st_mode ) )
+		{
+			fprintf( stderr, "-metrics: '%s' exists and is not a socket\n", path );
+			close( fd );
+			return false;
+		}
+		unlink( path );		// left over from a run that didn't shut down
+	}
+	if( bind( fd, (struct sockaddr *)&addr, sizeof(addr) ) < 0  ||  listen( fd, 4 ) < 0 )
+	{
+		fprintf( stderr, "-metrics: can't listen on '%s': %s\n", path, strerror( errno ) );
+		close( fd );
+		return false;
+	}
+
+	MetricsSocket = fd;
+	MetricsPath = path;
+	MetricsQuit = false;
+	MetricsOn = true;
+	MetricsThread = std::thread( MetricsServe, fd );
+	return true;
+#endif
+}
+
+
+void
+MetricsStop( )
+{
+	if( ! MetricsOn )
+		return;
+	MetricsOn = false;
+	MetricsQuit = true;
+	if( MetricsThread.joinable( ) )
+		MetricsThread.join( );
+#ifndef WIN32
+	close( MetricsSocket );
+	unlink( MetricsPath );
+#endif
+	MetricsSocket = -1;
+}
@@ -0,0 +1,166 @@
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+// drawing somewhere other than the window:
+//
+//	an Offscreen is a framebuffer object of any size -- rgba8 color and a 32-bit float depth
+//	buffer, so the reversed-z path can draw straight into it; Display( ) draws into RenderTarget
+//	instead of the window's back buffer when it is set, and doesn't swap
+//	OffscreenRead( ) copies the color back as top-down rgb, the way image files want it, and
+//	ReadPpm( ) / WritePpm( ) move that in and out of binary ppm (p6) files, which anything opens
+
+struct Offscreen
+{
+	GLuint	fbo, color, depth;
+	int		width, height;
+};
+
+
+// make (or remake, at a new size) an offscreen framebuffer, false (with a message) if we can't:
+
+bool
+OffscreenInit( struct Offscreen *o, int width, int height )
+{
+	if( ! GLEW_ARB_framebuffer_object  ||  ! GLEW_ARB_depth_buffer_float )
+	{
+		fprintf( stderr, "Offscreen rendering needs ARB_framebuffer_object and ARB_depth_buffer_float\n" );
+		return false;
+	}
+	if( o->fbo == 0 )
+	{
+		glGenFramebuffers( 1, &o->fbo );
+		glGenRenderbuffers( 1, &o->color );
+		glGenRenderbuffers( 1, &o->depth );
+	}
+	else
+		MemSub( MEM_TEXTURES_GPU, 8LL * o->width * o->height );
+
+	glBindRenderbuffer( GL_RENDERBUFFER, o->color );
+	glRenderbufferStorage( GL_RENDERBUFFER, GL_RGBA8, width, height );
+	glBindRenderbuffer( GL_RENDERBUFFER, o->depth );
+	glRenderbufferStorage( GL_RENDERBUFFER, GL_DEPTH_COMPONENT32F, width, height );
+	glBindRenderbuffer( GL_RENDERBUFFER, 0 );
+	glBindFramebuffer( GL_FRAMEBUFFER, o->fbo );
+	glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, o->color );
+	glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, o->depth );
+	GLenum status = glCheckFramebufferStatus( GL_FRAMEBUFFER );
+	glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+	o->width = width;
+	o->height = height;
+	MemAdd( MEM_TEXTURES_GPU, 8LL * width * height );		// rgba8 + depth32f
+
+	if( status != GL_FRAMEBUFFER_COMPLETE )
+	{
+		fprintf( stderr, "Offscreen framebuffer (%d x %d) is incomplete\n", width, height );
+		return false;
+	}
+	return true;
+}
+
+
+void
+OffscreenFree( struct Offscreen *o )
+{
+	if( o->fbo == 0 )
+		return;
+	glDeleteFramebuffers( 1, &o->fbo );
+	glDeleteRenderbuffers( 1, &o->color );
+	glDeleteRenderbuffers( 1, &o->depth );
+	MemSub( MEM_TEXTURES_GPU, 8LL * o->width * o->height );
+	memset( o, 0, sizeof(*o) );
+}
+
+
+// turn a bottom-up image, as gl reads it, the right way up -- in place:
+
+void
+FlipRows( unsigned char *pixels, int width, int height, int bytesPerPixel )
+{
+	int rowBytes = width * bytesPerPixel;
+	unsigned char *tmp = new unsigned char[ rowBytes ];
+	for( int y = 0; y < height / 2; y++ )
+	{
+		unsigned char *a = pixels + y * rowBytes;
+		unsigned char *b = pixels + ( height - 1 - y ) * rowBytes;
+		memcpy( tmp, a, rowBytes );
+		memcpy( a, b, rowBytes );
+		memcpy( b, tmp, rowBytes );
+	}
+	delete [ ] tmp;
+}
+
+
+// read the color buffer into rgb, width * height * 3 bytes, top row first:
+// this waits for the gpu to finish drawing
+
+void
+OffscreenRead( const struct Offscreen *o, unsigned char *rgb )
+{
+	glBindFramebuffer( GL_READ_FRAMEBUFFER, o->fbo );
+	glReadBuffer( GL_COLOR_ATTACHMENT0 );
+	glPixelStorei( GL_PACK_ALIGNMENT, 1 );
+	glReadPixels( 0, 0, o->width, o->height, GL_RGB, GL_UNSIGNED_BYTE, rgb );
+	glBindFramebuffer( GL_READ_FRAMEBUFFER, 0 );
+	FlipRows( rgb, o->width, o->height, 3 );
+}
+
+
+bool
+WritePpm( const char *filename, const unsigned char *rgb, int width, int height )
+{
+	FILE *fp = fopen( filename, "wb" );
+	if( fp == NULL )
+	{
+		fprintf( stderr, "Cannot write '%s'\n", filename );
+		return false;
+	}
+	fprintf( fp, "P6\n%d %d\n255\n", width, height );
+	bool ok = fwrite( rgb, 3, (size_t)width * height, fp ) == (size_t)width * height;
+	fclose( fp );
+	return ok;
+}
+
+
+// read a binary ppm, returning new[ ]'d rgb (top row first), or NULL if it isn't one we can read:
+
+unsigned char *
+ReadPpm( const char *filename, int *width, int *height )
+{
+	FILE *fp = fopen( filename, "rb" );
+	if( fp == NULL )
+		return NULL;
+
+	// the header is  P6 width height maxval , with # comments allowed between the fields:
+	int fields[3];
+	char magic[3] = { 0, 0, 0 };
+	bool ok = fread( magic, 1, 2, fp ) == 2  &&  strcmp( magic, "P6" ) == 0;
+	for( int f = 0; ok  &&  f < 3; f++ )
+	{
+		int c;
+		while( ( c = fgetc( fp ) ) == '#'  ||  isspace( c ) )
+			if( c == '#' )
+				while( ( c = fgetc( fp ) ) != '\n'  &&  c != EOF )
+					;
+		ungetc( c, fp );
+		ok = fscanf( fp, "%d", &fields[f] ) == 1;
+	}
+	ok = ok  &&  fgetc( fp ) != EOF  &&  fields[0] > 0  &&  fields[1] > 0  &&  fields[2] == 255;
+
+	unsigned char *rgb = NULL;
+	if( ok )
+	{
+		*width = fields[0];
+		*height = fields[1];
+		rgb = new unsigned char[ 3 * (size_t)*width * *height ];
+		if( fread( rgb, 3, (size_t)*width * *height, fp ) != (size_t)*width * *height )
+		{
+			delete [ ] rgb;
+			rgb = NULL;
+		}
+	}
+	fclose( fp );
+	if( rgb == NULL )
+		fprintf( stderr, "'%s' isn't a binary ppm we can read\n", filename );
+	return rgb;
+}
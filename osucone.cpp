@@ -2,7 +2,7 @@
 #include <math.h>
 #include <GL/gl.h>
 
-extern void Unit( float *, float * );
+extern float Unit( float *, float * );
 
 #ifndef POINT_H
 #define POINT_H
@@ -23,23 +23,30 @@ DrawPoint( struct point *p )
 }
 #endif
 
-int		ConeNumLngs, ConeNumLats;
-struct point *	ConePts;
+// one cone's points -- local to each OsuCone( ) call, like OsuSphere( )'s grid:
+
+struct ConeGrid
+{
+	int		numLngs, numLats;
+	struct point *	pts;
+};
 
 inline
 struct point *
-ConePtsPointer( int lat, int lng )
+ConePtsPointer( struct ConeGrid *g, int lat, int lng )
 {
-	if( lat < 0 )			lat += (ConeNumLats-1);
-	if( lng < 0 )			lng += (ConeNumLngs-0);
-	if( lat > ConeNumLats-1 )	lat -= (ConeNumLats-1);
-	if( lng > ConeNumLngs-1 )	lng -= (ConeNumLngs-0);
-	return &ConePts[ ConeNumLngs*lat + lng ];
+	if( lat < 0 )			lat += (g->numLats-1);
+	if( lng < 0 )			lng += (g->numLngs-0);
+	if( lat > g->numLats-1 )	lat -= (g->numLats-1);
+	if( lng > g->numLngs-1 )	lng -= (g->numLngs-0);
+	return &g->pts[ g->numLngs*lat + lng ];
 }
 
 
+// caps says whether to close off the ends -- false leaves them open, the way gluCylinder( ) draws:
+
 void
-OsuCone( float radBot, float radTop, float height, int slices, int stacks )
+OsuCone( float radBot, float radTop, float height, int slices, int stacks, bool caps = true )
 {
 	// gracefully handle degenerate case:
 
@@ -64,31 +71,35 @@ OsuCone( float radBot, float radTop, float height, int slices, int stacks )
 	stacks = fabs( stacks );
 	//fprintf( stderr, "%8.3f, %8.3f, %8.3f,  %3d, %3d\n", radBot, radTop, height, slices, stacks );
 
-	ConeNumLngs = slices;
-	if( ConeNumLngs < 3 )
-		ConeNumLngs = 3;
+	struct ConeGrid grid;
+
+	grid.numLngs = slices;
+	if( grid.numLngs < 3 )
+		grid.numLngs = 3;
 
-	ConeNumLats = stacks;
-	if( ConeNumLats < 3 )
-		ConeNumLats = 3;
+	grid.numLats = stacks;
+	if( grid.numLats < 3 )
+		grid.numLats = 3;
 
-	// allocate the point data structure:
+	// allocate the point data structure from this thread's frame arena, given back on return:
 
-	ConePts = new struct point[ ConeNumLngs * ConeNumLats ];
+	struct Arena *arena = FrameArena( );
+	struct ArenaMarker mark = ArenaMark( arena );
+	grid.pts = (struct point *)ArenaAlloc( arena, grid.numLngs * grid.numLats * sizeof(struct point) );
 
-	// fill the ConePts structure:
+	// fill the grid.pts structure:
 
-	for( int ilat = 0; ilat < ConeNumLats; ilat++ )
+	for( int ilat = 0; ilat < grid.numLats; ilat++ )
 	{
-		float t = (float)ilat / (float)(ConeNumLats-1);
+		float t = (float)ilat / (float)(grid.numLats-1);
 		float y = t * height;
 		float rad = t * radTop + ( 1. - t ) * radBot;
-		for( int ilng = 0; ilng < ConeNumLngs; ilng++ )
+		for( int ilng = 0; ilng < grid.numLngs; ilng++ )
 		{
-			float lng = -M_PI  +  2. * M_PI * (float)ilng / (float)(ConeNumLngs-1);
+			float lng = -M_PI  +  2. * M_PI * (float)ilng / (float)(grid.numLngs-1);
 			float x =  cos( lng );
 			float z = -sin( lng );
-			struct point *p = ConePtsPointer( ilat, ilng );
+			struct point *p = ConePtsPointer( &grid, ilat, ilng );
 			p->x  = rad * x;
 			p->y  = y;
 			p->z  = rad * z;
@@ -96,31 +107,31 @@ OsuCone( float radBot, float radTop, float height, int slices, int stacks )
 			p->ny = radBot - radTop;
 			p->nz = height*z;
 			Unit( &p->nx, &p->nx );
-			p->s = (float)ilng / (float)(ConeNumLngs-1);
-			p->t = (float)ilat / (float)(ConeNumLats-1);
+			p->s = (float)ilng / (float)(grid.numLngs-1);
+			p->t = (float)ilat / (float)(grid.numLats-1);
 		}
 	}
 
 
 	// draw the sides:
 
-	for( int ilat = 0; ilat < ConeNumLats-1; ilat++ )
+	for( int ilat = 0; ilat < grid.numLats-1; ilat++ )
 	{
 		glBegin( GL_TRIANGLE_STRIP );
 
 		struct point *p;
-		p = ConePtsPointer( ilat,   0 );
+		p = ConePtsPointer( &grid, ilat,   0 );
 		DrawPoint( p );
 
-		p = ConePtsPointer( ilat+1, 0 );
+		p = ConePtsPointer( &grid, ilat+1, 0 );
 		DrawPoint( p );
 
-		for( int ilng = 1; ilng < ConeNumLngs; ilng++ )
+		for( int ilng = 1; ilng < grid.numLngs; ilng++ )
 		{
-			p = ConePtsPointer( ilat,   ilng );
+			p = ConePtsPointer( &grid, ilat,   ilng );
 			DrawPoint( p );
 
-			p = ConePtsPointer( ilat+1, ilng );
+			p = ConePtsPointer( &grid, ilat+1, ilng );
 			DrawPoint( p );
 		}
 
@@ -129,10 +140,10 @@ OsuCone( float radBot, float radTop, float height, int slices, int stacks )
 
 	// draw the bottom circle:
 
-	if( radBot != 0. )
+	if( caps  &&  radBot != 0. )
 	{
-		struct point *bot = new struct point [ConeNumLngs];
-		for( int ilng = 0; ilng < ConeNumLngs; ilng++ )
+		struct point *bot = (struct point *)ArenaAlloc( arena, grid.numLngs * sizeof(struct point) );
+		for( int ilng = 0; ilng < grid.numLngs; ilng++ )
 		{
 			bot[ilng].x  = 0.;
 			bot[ilng].y  = 0.;
@@ -140,33 +151,32 @@ OsuCone( float radBot, float radTop, float height, int slices, int stacks )
 			bot[ilng].nx =  0.;
 			bot[ilng].ny = -1.;
 			bot[ilng].nz =  0.;
-			bot[ilng].s = (float)ilng / (float)(ConeNumLngs-1);
+			bot[ilng].s = (float)ilng / (float)(grid.numLngs-1);
 			bot[ilng].t = 0.;
 		}
 
 		glBegin( GL_TRIANGLES );
-		for( int ilng = ConeNumLngs-1; ilng >= 0; ilng-- )
+		for( int ilng = grid.numLngs-1; ilng >= 0; ilng-- )
 		{
 			struct point *p;
-			p = ConePtsPointer( 0, ilng+1 );
+			p = ConePtsPointer( &grid, 0, ilng+1 );
 			DrawPoint( p );
 
-			p = ConePtsPointer( 0, ilng );
+			p = ConePtsPointer( &grid, 0, ilng );
 			DrawPoint( p );
 
 			DrawPoint( &bot[ilng] );
 		}
 		glEnd( );
-		delete[ ] bot;
 	}
 
 
 	// draw the top circle:
 
-	if( radTop != 0. )
+	if( caps  &&  radTop != 0. )
 	{
-		struct point *top = new struct point [ConeNumLngs];
-		for( int ilng = 0; ilng < ConeNumLngs; ilng++ )
+		struct point *top = (struct point *)ArenaAlloc( arena, grid.numLngs * sizeof(struct point) );
+		for( int ilng = 0; ilng < grid.numLngs; ilng++ )
 		{
 			top[ilng].x  = 0.;
 			top[ilng].y  = height;
@@ -174,25 +184,24 @@ OsuCone( float radBot, float radTop, float height, int slices, int stacks )
 			top[ilng].nx = 0.;
 			top[ilng].ny = 1.;
 			top[ilng].nz = 0.;
-			top[ilng].s = (float)ilng / (float)(ConeNumLngs-1);
+			top[ilng].s = (float)ilng / (float)(grid.numLngs-1);
 			top[ilng].t = 1.;
 		}
 
 		glBegin( GL_TRIANGLES );
-		for( int ilng = 0; ilng < ConeNumLngs-1; ilng++ )
+		for( int ilng = 0; ilng < grid.numLngs-1; ilng++ )
 		{
 			struct point *p;
-			p = ConePtsPointer( ConeNumLats-1, ilng );
+			p = ConePtsPointer( &grid, grid.numLats-1, ilng );
 			DrawPoint( p );
 
-			p = ConePtsPointer( ConeNumLats-1, ilng+1 );
+			p = ConePtsPointer( &grid, grid.numLats-1, ilng+1 );
 			DrawPoint( p );
 
 			DrawPoint( &top[ilng] );
 		}
 		glEnd( );
-		delete [ ] top;
 	}
 
-	delete [ ] ConePts;
+	ArenaRelease( arena, mark );
 }
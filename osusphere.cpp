@@ -23,51 +23,61 @@ DrawPoint( struct point *p )
 }
 #endif
 
-int		SphNumLngs, SphNumLats;
-struct point *	SphPts;
+long long	OsuSpherePoints;		// points built by every OsuSphere( ) so far, for the performance counters
+
+// one sphere's points -- local to each OsuSphere( ) call, so several threads can build spheres at once:
+
+struct SphereGrid
+{
+	int		numLngs, numLats;
+	struct point *	pts;
+};
 
 inline
 struct point *
-SphPtsPointer( int lat, int lng )
+SphPtsPointer( struct SphereGrid *g, int lat, int lng )
 {
-	if( lat < 0 )			lat += (SphNumLats-1);
-	if( lng < 0 )			lng += (SphNumLngs-0);
-	if( lat > SphNumLats-1 )	lat -= (SphNumLats-1);
-	if( lng > SphNumLngs-1 )	lng -= (SphNumLngs-0);
-	return &SphPts[ SphNumLngs*lat + lng ];
+	if( lat < 0 )			lat += (g->numLats-1);
+	if( lng < 0 )			lng += (g->numLngs-0);
+	if( lat > g->numLats-1 )	lat -= (g->numLats-1);
+	if( lng > g->numLngs-1 )	lng -= (g->numLngs-0);
+	return &g->pts[ g->numLngs*lat + lng ];
 }
 
 void
 OsuSphere( float radius, int slices, int stacks )
 {
-	// set the globals:
+	struct SphereGrid grid;
 
-	SphNumLngs = slices;
-	SphNumLats = stacks;
-	if( SphNumLngs < 3 )
-		SphNumLngs = 3;
-	if( SphNumLats < 3 )
-		SphNumLats = 3;
+	grid.numLngs = slices;
+	grid.numLats = stacks;
+	if( grid.numLngs < 3 )
+		grid.numLngs = 3;
+	if( grid.numLats < 3 )
+		grid.numLats = 3;
 
-	// allocate the point data structure:
+	// allocate the point data structure from this thread's frame arena, given back on return:
 
-	SphPts = new struct point[ SphNumLngs * SphNumLats ];
+	struct Arena *arena = FrameArena( );
+	struct ArenaMarker mark = ArenaMark( arena );
+	grid.pts = (struct point *)ArenaAlloc( arena, grid.numLngs * grid.numLats * sizeof(struct point) );
+	OsuSpherePoints += grid.numLngs * grid.numLats;
 
-	// fill the SphPts structure:
+	// fill the grid.pts structure:
 
-	for( int ilat = 0; ilat < SphNumLats; ilat++ )
+	for( int ilat = 0; ilat < grid.numLats; ilat++ )
 	{
-		float lat = -M_PI/2.  +  M_PI * (float)ilat / (float)(SphNumLats-1);	// ilat=0/lat=0. is the south pole
-											// ilat=SphNumLats-1, lat=+M_PI/2. is the north pole
+		float lat = -M_PI/2.  +  M_PI * (float)ilat / (float)(grid.numLats-1);	// ilat=0/lat=0. is the south pole
+											// ilat=grid.numLats-1, lat=+M_PI/2. is the north pole
 		float xz = cosf( lat );
 		float  y = sinf( lat );
-		for( int ilng = 0; ilng < SphNumLngs; ilng++ )				// ilng=0, lng=-M_PI and
-											// ilng=SphNumLngs-1, lng=+M_PI are the same meridian
+		for( int ilng = 0; ilng < grid.numLngs; ilng++ )				// ilng=0, lng=-M_PI and
+											// ilng=grid.numLngs-1, lng=+M_PI are the same meridian
 		{
-			float lng = -M_PI  +  2. * M_PI * (float)ilng / (float)(SphNumLngs-1);
+			float lng = -M_PI  +  2. * M_PI * (float)ilng / (float)(grid.numLngs-1);
 			float x =  xz * cosf( lng );
 			float z = -xz * sinf( lng );
-			struct point* p = SphPtsPointer( ilat, ilng );
+			struct point* p = SphPtsPointer( &grid, ilat, ilng );
 			p->x  = radius * x;
 			p->y  = radius * y;
 			p->z  = radius * z;
@@ -95,15 +105,15 @@ OsuSphere( float radius, int slices, int stacks )
 	bot.nx = 0.;		bot.ny = -1.;		bot.nz = 0.;
 	bot.s  = 0.;		bot.t  =  0.;
 
-	// connect the north pole to the latitude SphNumLats-2:
+	// connect the north pole to the latitude grid.numLats-2:
 
 	glBegin(GL_TRIANGLE_STRIP);
-	for (int ilng = 0; ilng < SphNumLngs; ilng++)
+	for (int ilng = 0; ilng < grid.numLngs; ilng++)
 	{
-		float lng = -M_PI + 2. * M_PI * (float)ilng / (float)(SphNumLngs - 1);
+		float lng = -M_PI + 2. * M_PI * (float)ilng / (float)(grid.numLngs - 1);
 		top.s = (lng + M_PI) / (2. * M_PI);
 		DrawPoint(&top);
-		struct point* p = SphPtsPointer(SphNumLats - 2, ilng);	// ilat=SphNumLats-1 is the north pole
+		struct point* p = SphPtsPointer(&grid, grid.numLats - 2, ilng);	// ilat=grid.numLats-1 is the north pole
 		DrawPoint(p);
 	}
 	glEnd();
@@ -111,27 +121,27 @@ OsuSphere( float radius, int slices, int stacks )
 	// connect the south pole to the latitude 1:
 
 	glBegin( GL_TRIANGLE_STRIP );
-	for (int ilng = SphNumLngs - 1; ilng >= 0; ilng--)
+	for (int ilng = grid.numLngs - 1; ilng >= 0; ilng--)
 	{
-		float lng = -M_PI + 2. * M_PI * (float)ilng / (float)(SphNumLngs - 1);
+		float lng = -M_PI + 2. * M_PI * (float)ilng / (float)(grid.numLngs - 1);
 		bot.s = (lng + M_PI) / (2. * M_PI);
 		DrawPoint(&bot);
-		struct point* p = SphPtsPointer(1, ilng);					// ilat=0 is the south pole
+		struct point* p = SphPtsPointer(&grid, 1, ilng);					// ilat=0 is the south pole
 		DrawPoint(p);
 	}
 	glEnd();
 
 	// connect the horizontal strips:
 
-	for( int ilat = 2; ilat < SphNumLats-1; ilat++ )
+	for( int ilat = 2; ilat < grid.numLats-1; ilat++ )
 	{
 		struct point* p;
 		glBegin(GL_TRIANGLE_STRIP);
-		for( int ilng = 0; ilng < SphNumLngs; ilng++ )
+		for( int ilng = 0; ilng < grid.numLngs; ilng++ )
 		{
-			p = SphPtsPointer( ilat, ilng );
+			p = SphPtsPointer( &grid, ilat, ilng );
 			DrawPoint( p );
-			p = SphPtsPointer( ilat-1, ilng );
+			p = SphPtsPointer( &grid, ilat-1, ilng );
 			DrawPoint( p );
 		}
 		glEnd();
@@ -139,6 +149,6 @@ OsuSphere( float radius, int slices, int stacks )
 
 	// clean-up:
 
-	delete [ ] SphPts;
-	SphPts = NULL;
+	ArenaRelease( arena, mark );
+	grid.pts = NULL;
 }
@@ -0,0 +1,264 @@
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+// hardware performance counters per phase (linux perf_event_open):
+//
+//	PerfStart( ) opens one group of counters -- cycles, instructions, l1d read misses, last-level
+//	cache misses, branch misses -- on the calling thread; a group is scheduled onto the pmu all
+//	together, so the ratios between them are from the same stretch of time
+//	PerfBegin( phase ) / PerfEnd( phase, units ) add the counts in between to the phase, with
+//	units saying how much work that was (stars, sphere points, belt bodies), so the report can
+//	give ipc and misses per unit -- the thing that says cache-bound or branch-bound
+//	only the thread that called PerfStart( ) is counted: put phases around work it does itself
+//	when counters can't be opened (not linux, perf_event_paranoid, a vm without a pmu),
+//	PerfStart( ) says why and returns false, and everything else quietly does nothing; if the
+//	group can't be read later on, what was counted so far is thrown away the same way, so a
+//	report never shows half a run
+
+#define PERF_CYCLES				0
+#define PERF_INSTRUCTIONS		1
+#define PERF_L1D_MISSES			2
+#define PERF_LLC_MISSES			3
+#define PERF_BRANCH_MISSES		4
+#define NUM_PERF_COUNTERS		5
+
+#define PERF_PHASE_STARS		0		// DrawStars( ), per star drawn
+#define PERF_PHASE_BODIES		1		// the sun and planets, per OsuSphere( ) point
+#define PERF_PHASE_BELTS		2		// DrawBelts( ), per belt body drawn
+#define PERF_PHASE_BELT_UPDATE	3		// BeltUpdate( ) in -beltbench, per belt body
+#define NUM_PERF_PHASES			4
+
+static const char *	PerfCounterNames[NUM_PERF_COUNTERS] = { "cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses" };
+static const char *	PerfPhaseNames[NUM_PERF_PHASES] = { "draw stars", "draw bodies", "draw belts", "belt update" };
+static const char *	PerfPhaseUnits[NUM_PERF_PHASES] = { "star", "sphere point", "belt body", "belt body" };
+
+struct PerfPhase
+{
+	long long	counts[NUM_PERF_COUNTERS];
+	long long	units;
+	int			samples;
+	long long	begin[NUM_PERF_COUNTERS];		// the counters at PerfBegin( )
+};
+
+bool			PerfOn;							// the counters are open
+int				PerfFd[NUM_PERF_COUNTERS];		// -1 for a counter this machine doesn't have
+int				PerfSlot[NUM_PERF_COUNTERS];	// its position in the group's read( )
+int				PerfNumOpen;
+struct PerfPhase	PerfPhases[NUM_PERF_PHASES];
+
+
+#ifdef __linux__
+static int
+PerfOpenCounter( unsigned int type, unsigned long long config, int groupFd )
+{
+	struct perf_event_attr attr;
+	memset( &attr, 0, sizeof(attr) );
+	attr.size = sizeof(attr);
+	attr.type = type;
+	attr.config = config;
+	attr.disabled = groupFd == -1 ? 1 : 0;		// the leader starts the whole group
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+	return (int)syscall( __NR_perf_event_open, &attr, 0, -1, groupFd, 0 );
+}
+#endif
+
+
+// open the counters on this thread, false (with a message) if we can't:
+
+bool
+PerfStart( )
+{
+	PerfOn = false;
+	PerfNumOpen = 0;
+	for( int k = 0; k < NUM_PERF_COUNTERS; k++ )
+		PerfFd[k] = -1;
+	memset( PerfPhases, 0, sizeof(PerfPhases) );
+
+#ifdef __linux__
+	const unsigned long long l1dReadMiss = PERF_COUNT_HW_CACHE_L1D | ( PERF_COUNT_HW_CACHE_OP_READ << 8 ) | ( PERF_COUNT_HW_CACHE_RESULT_MISS << 16 );
+	unsigned int types[NUM_PERF_COUNTERS] = { PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE };
+	unsigned long long configs[NUM_PERF_COUNTERS] = { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, l1dReadMiss, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES };
+
+	// cycles leads the group; without it there's nothing to compare against:
+	PerfFd[PERF_CYCLES] = PerfOpenCounter( types[PERF_CYCLES], configs[PERF_CYCLES], -1 );
+	if( PerfFd[PERF_CYCLES] < 0 )
+	{
+		int err = errno;
+		fprintf( stderr, "Performance counters unavailable (%s)", strerror( err ) );
+		if( err == EACCES  ||  err == EPERM )
+			fprintf( stderr, " -- see /proc/sys/kernel/perf_event_paranoid" );
+		fprintf( stderr, "\n" );
+		return false;
+	}
+	PerfSlot[PERF_CYCLES] = PerfNumOpen++;
+
+	// the rest are optional -- some cpus and vms don't have all of them:
+	for( int k = 1; k < NUM_PERF_COUNTERS; k++ )
+	{
+		PerfFd[k] = PerfOpenCounter( types[k], configs[k], PerfFd[PERF_CYCLES] );
+		if( PerfFd[k] >= 0 )
+			PerfSlot[k] = PerfNumOpen++;
+		else
+			fprintf( stderr, "Performance counter '%s' unavailable (%s)\n", PerfCounterNames[k], strerror( errno ) );
+	}
+
+	ioctl( PerfFd[PERF_CYCLES], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP );
+	ioctl( PerfFd[PERF_CYCLES], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP );
+	PerfOn = true;
+	return true;
+#else
+	fprintf( stderr, "Performance counters are only read on linux\n" );
+	return false;
+#endif
+}
+
+
+void
+PerfStop( )
+{
+#ifdef __linux__
+	for( int k = 0; k < NUM_PERF_COUNTERS; k++ )
+		if( PerfFd[k] >= 0 )
+			close( PerfFd[k] );
+#endif
+	for( int k = 0; k < NUM_PERF_COUNTERS; k++ )
+		PerfFd[k] = -1;
+	PerfOn = false;
+}
+
+
+// a read of the group failed: close it and forget the counts, which are now incomplete, so the
+// reports say the counters are unavailable rather than show them:
+
+static void
+PerfFail( )
+{
+	fprintf( stderr, "Performance counters stopped: the group couldn't be read\n" );
+	PerfStop( );
+	PerfNumOpen = 0;
+	memset( PerfPhases, 0, sizeof(PerfPhases) );
+}
+
+
+// the whole group in one read( ), scaled up if the pmu had to time-share it:
+
+static bool
+PerfRead( long long values[NUM_PERF_COUNTERS] )
+{
+#ifdef __linux__
+	unsigned long long buf[ 3 + NUM_PERF_COUNTERS ];		// nr, time enabled, time running, values
+	if( read( PerfFd[PERF_CYCLES], buf, sizeof(buf) ) < (ssize_t)( ( 3 + PerfNumOpen ) * sizeof(buf[0]) ) )
+		return false;
+	double scale = buf[2] > 0 ? (double)buf[1] / (double)buf[2] : 1.;
+	for( int k = 0; k < NUM_PERF_COUNTERS; k++ )
+		values[k] = PerfFd[k] >= 0 ? (long long)( buf[ 3 + PerfSlot[k] ] * scale ) : 0;
+	return true;
+#else
+	return false;
+#endif
+}
+
+
+inline
+void
+PerfBegin( int phase )
+{
+	if( PerfOn  &&  ! PerfRead( PerfPhases[phase].begin ) )
+		PerfFail( );
+}
+
+
+void
+PerfEnd( int phase, long long units )
+{
+	if( ! PerfOn )
+		return;
+	long long now[NUM_PERF_COUNTERS];
+	if( ! PerfRead( now ) )
+	{
+		PerfFail( );
+		return;
+	}
+	struct PerfPhase *p = &PerfPhases[phase];
+	for( int k = 0; k < NUM_PERF_COUNTERS; k++ )
+		p->counts[k] += now[k] - p->begin[k];
+	p->units += units;
+	p->samples++;
+}
+
+
+void
+PerfReport( FILE *fp )
+{
+	if( PerfNumOpen == 0 )
+	{
+		fprintf( fp, "counters unavailable\n" );
+		return;
+	}
+	fprintf( fp, "%-14s %8s %8s %12s %12s %12s %12s  %s\n", "counters", "ipc", "samples",
+		"cycles/u", "l1d miss/u", "llc miss/u", "br miss/u", "u" );
+	for( int ph = 0; ph < NUM_PERF_PHASES; ph++ )
+	{
+		const struct PerfPhase *p = &PerfPhases[ph];
+		if( p->samples == 0  ||  p->units == 0 )
+			continue;
+		double u = (double)p->units;
+		fprintf( fp, "%-14s %8.2f %8d %12.2f", PerfPhaseNames[ph],
+			(double)p->counts[PERF_INSTRUCTIONS] / (double)( p->counts[PERF_CYCLES] > 0 ? p->counts[PERF_CYCLES] : 1 ),
+			p->samples, p->counts[PERF_CYCLES] / u );
+		for( int k = PERF_L1D_MISSES; k <= PERF_BRANCH_MISSES; k++ )
+		{
+			if( PerfFd[k] >= 0 )
+				fprintf( fp, " %12.4f", p->counts[k] / u );
+			else
+				fprintf( fp, " %12s", "-" );
+		}
+		fprintf( fp, "  %s\n", PerfPhaseUnits[ph] );
+	}
+}
+
+
+// write  "counters": { ... }  with no comma or newline after it, each line starting with indent;
+// a counter this machine doesn't have is null, and so is everything when none could be opened
+
+void
+PerfReportJson( FILE *fp, const char *indent )
+{
+	if( PerfNumOpen == 0 )
+	{
+		fprintf( fp, "%s\"counters\": null", indent );
+		return;
+	}
+	fprintf( fp, "%s\"counters\": {\n", indent );
+	const char *sep = "";
+	for( int ph = 0; ph < NUM_PERF_PHASES; ph++ )
+	{
+		const struct PerfPhase *p = &PerfPhases[ph];
+		if( p->samples == 0  ||  p->units == 0 )
+			continue;
+		double u = (double)p->units;
+		fprintf( fp, "%s%s  \"%s\": { \"per\": \"%s\", \"units\": %lld, \"ipc\": %.3f", sep, indent, PerfPhaseNames[ph],
+			PerfPhaseUnits[ph], p->units,
+			(double)p->counts[PERF_INSTRUCTIONS] / (double)( p->counts[PERF_CYCLES] > 0 ? p->counts[PERF_CYCLES] : 1 ) );
+		for( int k = 0; k < NUM_PERF_COUNTERS; k++ )
+		{
+			if( PerfFd[k] >= 0 )
+				fprintf( fp, ", \"%s_per\": %.4f", PerfCounterNames[k], p->counts[k] / u );
+			else
+				fprintf( fp, ", \"%s_per\": null", PerfCounterNames[k] );
+		}
+		fprintf( fp, " }" );
+		sep = ",\n";
+	}
+	fprintf( fp, "\n%s}", indent );
+}
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <string.h>
 #include <string>
 
 #define _USE_MATH_DEFINES
@@ -16,8 +17,31 @@
 #include <GL/glu.h>
 #include "glut.h"
 #include "Header.h"
+#include "memtrack.cpp"
+#include "trace.cpp"
+#include "perfcounters.cpp"
+#include "latency.cpp"
+#include "metrics.cpp"
+#include "arena.cpp"
+#include "jobs.cpp"
 #include "osusphere.cpp"
+#include "osucone.cpp"
 #include "osutorus.cpp"
+#include "hudtext.cpp"
+#include "mappedfile.cpp"
+#include "simsync.cpp"
+#include "ephemeris.cpp"
+#include "chebyshev.cpp"
+#include "system.cpp"
+#include "bodystore.cpp"
+#include "scenegraph.cpp"
+#include "culling.cpp"
+#include "bvh.cpp"
+#include "belts.cpp"
+#include "scenario.cpp"
+#include "offscreen.cpp"
+#include "golden.cpp"
+#include "video.cpp"
 
 
 //	This is a sample OpenGL / GLUT program
@@ -108,6 +132,16 @@ enum TextureChoices
 	HIGH
 };
 
+// simulation commands -- queued by the ui, applied by SimStep( ):
+
+enum SimCommands
+{
+	SIM_FASTER,
+	SIM_SLOWER,
+	SIM_LIGHTSPEED,
+	SIM_RESET
+};
+
 // window background color (rgba):
 
 const GLfloat BACKCOLOR[ ] = { 0., 0., 0., 1. };
@@ -184,23 +218,91 @@ const GLfloat FOGEND      = 4.f;
 #define SPEED_MAX .05
 #define SPEED_MIN 0.
 #define NUM_STARS 1000
+#define STAR_CHUNKS_PER_AXIS	4		// the star cube is cut into 4x4x4 chunks for culling
+#define NUM_STAR_CHUNKS			( STAR_CHUNKS_PER_AXIS * STAR_CHUNKS_PER_AXIS * STAR_CHUNKS_PER_AXIS )
+#define STAR_CUBE_HALF			1000	// stars lie in [-1000,1000) on each axis
+
+// fixed-timestep simulation:
+//	the simulation runs on its own thread, in SIM_TICK_MS steps no matter how fast we render
+//	it owns the ship's motion and everything the controls change; after each tick it publishes
+//	a SimSnapshot through a triple buffer, and Animate( ) and Display( ) only ever read that
+//	snapshot, interpolating between its last two ticks
+//	input goes the other way through a lock-free queue, so a slow frame never holds up either
+
+#define SIM_TICK_MS		(1000. / 120.)
+#define SIM_MAX_FRAME_MS	250.			// clamp a stalled frame so we don't spiral
+#define DEFAULT_SWEEP_TOURS	40
+#define SWEEP_MAX_TICKS		10000000		// give up on a tour that never reaches the end
+#define SWEEP_RAMP_TICKS	240				// the slowest ramp presses SIM_FASTER every 2 seconds
+
+// frame scheduling:
+//	frames are paced by a glut timer at TargetFPS, and the timer is not
+//	re-armed while the ship is at rest or the window is hidden
+
+#define DEFAULT_TARGET_FPS	60
+#define DEFAULT_OFFSCREEN_SIZE	512		// -size, for frames drawn offscreen
+
+// reversed-z depth:
+//	the scene is drawn into an offscreen framebuffer with a 32-bit float depth buffer,
+//	depth cleared to 0. and tested with GL_GREATER, and an infinite far plane
+
+#define NEAR_PLANE	0.1f
+#define FAR_PLANE	1000.f		// only used by the standard depth path
+
+// world positions are kept in miles, in double precision
+// they are only made relative to the ship, scaled, and converted to float when drawn
 
 #define RADIUS_SCALE_FACTOR 10000
 #define DISTANCE_SCALE_FACTOR 500000
-struct Solar_System_Obj {
-	char* name;
-	float x;
-	float y;
-	float z;
-	float radius; // in miles
-	float radius_scaled;
-	float off_axis_tilt;
-	float rotate_angle = 0;
-	float solar_distance;  // distance from sun in miles
-	float distance_scaled;
-	GLuint texture_name;
+#define SUN_LIGHT_OFFSET_X	-50.	// sunlight is placed this many scene units behind the sun...
+#define SUN_LIGHT_OFFSET_Z	-1.		// ...and this many off axis (at the default scale)
+#define NEARBY_SCENE_RADIUS	200.	// the statistics name the nearest body within this many scene units of the ship
+#define FRAME_ARENA_BYTES	(256*1024)	// starting size of each thread's frame arena; they grow to fit
+
+// one tour's simulation state -- everything a tick reads or writes, so any number of tours can
+// run side by side (see -sweep); the interactive tour is Sim, run by the simulation thread:
+
+struct SimContext
+{
+	double	travel, prevTravel;		// miles along +x at this tick and the one before
+	double	simTimeMS;				// simulated time since the tour started
+	double	velocity;				// DISTANCE_SCALE_FACTOR miles per millisecond
+	float	lightSpeedMultiple;
+	float	engineAmbient, engineDiffuse, engineSpecular;
+	float	redShift[3], blueShift[3];	// star colors behind and ahead
+	bool	forward;				// last asked to speed up rather than slow down
+	bool	flip;					// the ship has turned around at least once
+	double	tourLength;				// route distance of the farthest body, miles
+	struct CommandQueue input;		// SimCommands waiting for the next tick
+	int		inputsApplied;			// commands popped from input so far (a reset doesn't clear it)
+	std::chrono::steady_clock::time_point appliedAt[LATENCY_APPLIED];	// when command n was popped, at n % LATENCY_APPLIED
+};
+
+// a 4-float array returned by value, so the temporary lives to the end of the statement
+// that uses .v -- e.g. glLightfv( l, GL_DIFFUSE, Array3( r, g, b ).v ):
+
+struct Vec4
+{
+	float	v[4];
 };
 
+// what the simulation thread hands the render thread after each tick:
+
+struct SimSnapshot
+{
+	double	travel, prevTravel;		// miles along +x at this tick and the one before
+	double	simTimeMS;				// simulated time since the tour started
+	double	velocity;
+	float	lightSpeedMultiple;
+	float	engineAmbient, engineDiffuse, engineSpecular;
+	float	redShift[3], blueShift[3];
+	bool	forward;				// ForwardDirection
+	bool	flip;					// FlipSpaceship
+	bool	moving;					// the next tick will change something
+	int		inputsApplied;			// for the latency tracker
+	std::chrono::steady_clock::time_point appliedAt[LATENCY_APPLIED];
+	std::chrono::steady_clock::time_point published;
+};
 
 // non-constant global variables:
 
@@ -220,33 +322,92 @@ int		WhichProjection;		// ORTHO or PERSP
 int		WhichTexture = HIGH;
 int		Xmouse, Ymouse;			// mouse values
 float	Xrot, Yrot;				// rotation angles in degrees
-unsigned char *sunTexture, *texture, *mercuryTexture, *venusTexture, *marsTexture, *earthTexture, *jupiterTexture, *saturnTexture, *uranusTexture, *neptuneTexture, *spaceshipTexture;
-GLuint	SunTex, MercuryTex, VenusTex, EarthTex, MarsTex, Tex3, JupiterTex, SaturnTex, UranusTex, NeptuneTex, SpaceshipTex;
-float	travel;
-float	PreviousMS = 0.;
-double	velocity = 0.;
+unsigned char *spaceshipTexture;
+GLuint	SpaceshipTex;
+double	RenderTravel;			// travel interpolated for the frame being drawn, from SimFrame
+double	DistanceScale = DISTANCE_SCALE_FACTOR;	// miles per scene unit for distances
+double	RadiusScale = RADIUS_SCALE_FACTOR;		// miles per scene unit for radii
+int		TargetFPS = DEFAULT_TARGET_FPS;	// set with -fps on the command line
+int		NextFrameMS;			// when the next paced frame is due
+bool	FrameTimerArmed = false;	// true while a FrameTimer( ) callback is pending
+bool	WindowVisible = true;
+bool	ReversedZOn = false;		// 'z' key or -reversedz on the command line
+bool	ReversedZSupported = false;	// set after glewInit( ) if the extensions are there
+GLuint	ReversedZFbo, ReversedZColor, ReversedZDepth;
+int		ReversedZWidth, ReversedZHeight;	// size the renderbuffers were allocated at
 float	White[3] = { 1., 1., 1. };
-float	EngineAmbient = 0.;
-float	EngineDiffuse = 0.;
-float	EngineSpecular = 0.;
 float	SunMinDiffuse = .5;
-float	LightSpeedMultiple = 0.;
-bool	ForwardDirection = true;
-bool	FlipSpaceship = false;
-GLfloat RedShift[] = {1.0, 1.0, 1.0};
-GLfloat BlueShift[] = { 1.0, 1.0, 1.0 };
-int		StarLocations[NUM_STARS][3]; // gets filled in by getRandomStarLocations()
+struct HudString VelocityHud;		// rebuilt by setVelocityText( ) when the speed changes
+int		NumStars = NUM_STARS;		// set with -stars, or by a scenario
+int		(*StarLocations)[3];		// gets filled in by getRandomStarLocations()
+float	(*StarChunkVerts)[3];		// the same stars sorted by chunk, for glDrawArrays( )
+int		StarChunkFirst[NUM_STAR_CHUNKS + 1];	// chunk c is StarChunkVerts[ StarChunkFirst[c] .. StarChunkFirst[c+1] )
+struct Frustum ViewFrustum;			// this frame's, in ship-relative scene coordinates
+struct CullStats Stats;				// what this frame drew and skipped
+bool	StatsOn = false;			// 'i' shows the culling statistics
+struct HudString StatsHud;
+struct HudString ArenaHud;
+struct HudString MemHud;
+struct HudString LatencyHud;
+bool	LatencyTimerArmed = false;	// LatencyTimer( ) is waiting on a frame's fence
+
+// the simulation thread:
+//	Sim belongs to it once it is started -- everything else reads SimFrame, and sends it input
+//	through Sim.input
+struct SimContext Sim;
+struct TripleBuffer<struct SimSnapshot> SimSnapshots;	// simulation -> render
+const struct SimSnapshot *SimFrame;	// the snapshot the current frame is drawn from
+std::thread SimThread;
+std::atomic<bool> SimQuit;
 
 // create sun, planet objects
-struct Solar_System_Obj Sun;
-struct Solar_System_Obj Mercury;
-struct Solar_System_Obj Venus;
-struct Solar_System_Obj Earth;
-struct Solar_System_Obj Mars;
-struct Solar_System_Obj Jupiter;
-struct Solar_System_Obj Saturn;
-struct Solar_System_Obj Uranus;
-struct Solar_System_Obj Neptune;
+struct SystemDesc System;				// the loaded description file
+const char *SystemFile = "Solar_system/sol.txt";	// set with -system
+struct BodyStore Bodies;				// one per body in System, parents first
+int		SunIndex = -1;					// the first star, which lights the scene
+struct SceneGraph Scene;				// the ship and its parts, and every body
+int		*BodyNode;						// each body's node in Scene
+int		ShipNode, ShipBodyNode, ShipEngineNode, ShipVentLightNode, ShipVentConeNode, ShipNoseNode;
+double	TourLength;						// route distance of the farthest body, miles
+
+struct Ephemeris PlanetEphemeris;	// all planets' orbits, evaluated together
+struct ChebyshevCache PlanetCache;	// set with -ephem; used instead of PlanetEphemeris for dates it covers
+double	TourJulianDate = 0.;		// set with -date; 0. means the classic fixed layout
+
+struct ParticleBelt AsteroidBelt;
+struct ParticleBelt KuiperBelt;
+int		BeltBodies = DEFAULT_BELT_BODIES;	// per belt, set with -belts; 0 turns the belts off
+
+struct JobSystem Jobs;				// per-frame cpu work runs on this; only GL calls stay on the main thread
+int		JobThreads = 0;				// set with -threads; 0 means one per core
+struct JobGraph AnimateGraph;		// the orbit updates, run each Animate( )
+struct JobGraph CullGraph;			// posing, culling and the bvh refit, run each Display( )
+int		VisibleChunks[NUM_STAR_CHUNKS];	// star chunks the frustum query found this frame
+int		NumVisibleChunks;
+
+// bounding-volume hierarchies, in ship-relative scene coordinates:
+struct Bvh WorldBvh;				// every body, then the asteroid belt clusters, then the kuiper belt clusters
+struct Bvh SkyBvh;					// the star chunks, which never move relative to the ship
+int		NumWorldItems;				// objects in WorldBvh, 0 until the first frame builds it
+double	(*WorldCenter)[3];			// each object's bounding sphere this frame
+double	*WorldRadius;
+unsigned char *InView;				// != 0 if the frustum query found the object this frame
+int		*BvhHits;					// query results, room for every object in either tree
+GLdouble PickProjection[16], PickModelview[16];	// this frame's matrices, for turning a click into a ray
+GLint	PickViewport[4];
+int		PickedItem = -1;			// shift-click selection in WorldBvh, -1 for none
+struct HudString PickHud;
+
+// scripted scenarios (see scenario.cpp):
+const char *ScenarioFile;			// set with -scenarios
+const char *ScenarioBaseline;		// -baseline, to compare against
+const char *ScenarioSaveBaseline;	// -savebaseline, to write the results to
+std::vector<struct Scenario> Scenarios;
+bool	FixedStep = false;			// RunScenarios( ) steps the simulation, not the clock: draw each tick as it is
+struct Offscreen *RenderTarget;		// where Display( ) draws, NULL for the window
+struct Offscreen FrameTarget;		// for -golden and -video
+int		OffscreenWidth = DEFAULT_OFFSCREEN_SIZE;	// set with -size
+int		OffscreenHeight = DEFAULT_OFFSCREEN_SIZE;
 
 // function prototypes:
 void	Animate( );
@@ -268,21 +429,62 @@ void	MouseMotion( int, int );
 void	Reset( );
 void	Resize( int, int );
 void	Visibility( int );
-void	DrawPlanet(struct Solar_System_Obj, float, float);
-void	DrawSun(struct Solar_System_Obj);
-void	IncreaseVelocity(void);
-void	DecreaseVelocity(void);
+void	DrawPlanet(int);
+void	WorldToScene(double, double, double, float[3]);
+void	DrawSun(int);
+void	IncreaseVelocity(struct SimContext *);
+void	DecreaseVelocity(struct SimContext *);
 void	CreateSolarSystem(void);
-float*	MulArray3(float factor, float array0[3]);
+struct Vec4	MulArray3(float factor, const float array0[3]);
 void	SetMaterial(float, float, float, float);
-float*	Array3(float, float, float);
+struct Vec4	Array3(float, float, float);
 void	SetSunLight(int, float, float, float, float, float, float);
-float	getLightSpeedMultiple(int);
-void	setVelocityText(void);
+float	getLightSpeedMultiple(struct SimContext *, int);
+void	setVelocityText(int);
 void	DrawStars(int);
 void	getRandomStarLocations(int);
-void	GoLightSpeed(void);
-void	ChangeLightShift(int);
+void	BuildStarChunks(void);
+bool	BodyVisible(int);
+bool	ShipPartVisible(int, float, float);
+void	setStatsText(int);
+void	GoLightSpeed(struct SimContext *);
+void	ChangeLightShift(struct SimContext *, int);
+void	PostSimCommand(int);
+void	LatencyTimer(int);
+void	SimInit(struct SimContext *);
+void	SimStep(struct SimContext *);
+void	SimReset(struct SimContext *);
+void	SimPublish(void);
+void	SimThreadMain(void);
+void	StopThreads(void);
+void	RunSweep(int, FILE *);
+bool	RunScenarios(FILE *);
+bool	RunVideo(void);
+void	ScenarioTimer(int);
+void	FrameTimer(int);
+void	WakeAnimation(void);
+bool	NeedsAnimation(void);
+void	BindFrameTarget(void);
+int		FrameWidth(void);
+int		FrameHeight(void);
+bool	BeginReversedZ(void);
+void	EndReversedZ(void);
+void	LoadInfiniteReversedPerspective(float, float, float);
+bool	InitBodies(void);
+void	PlaceBodies(void);
+void	InitScene(void);
+void	UpdateScene(void);
+void	LoadBodyTextures(void);
+void	UpdatePlanetPositions(void);
+void	InitBelts(void);
+void	UpdateBelts(void);
+int		DrawBelts(void);
+void	InitFrameGraphs(void);
+void	CullStars(void);
+void	UpdateWorldBvh(void);
+const char *WorldItemName(int, char *);
+void	PickAt(int, int);
+void	setPickText(int);
 
 void			Axes( float );
 
@@ -302,12 +504,190 @@ float			Unit(float [3], float [3]);
 int
 main( int argc, char *argv[ ] )
 {
+	// the system description, the tour date, the thread count and the batch options need no
+	// window, so handle them before glut opens one:
+
+	for( int i = 1; i < argc-1; i++ )
+	{
+		if( strcmp( argv[i], "-system" ) == 0 )
+			SystemFile = argv[i+1];
+		if( strcmp( argv[i], "-threads" ) == 0 )
+			JobThreads = atoi( argv[i+1] );
+		if( strcmp( argv[i], "-date" ) == 0 )
+		{
+			int year, month, day;
+			if( sscanf( argv[i+1], "%d-%d-%d", &year, &month, &day ) == 3 )
+				TourJulianDate = JulianDate( year, month, (double)day );
+			else
+				fprintf( stderr, "-date wants YYYY-MM-DD, not '%s'\n", argv[i+1] );
+		}
+	}
+	if( ! LoadSystem( &System, SystemFile )  ||  ! InitBodies( ) )
+		return 1;
+
+	for( int i = 1; i < argc; i++ )
+	{
+		if( strcmp( argv[i], "-compilesystem" ) == 0  &&  i+2 < argc )
+		{
+			struct SystemDesc sd;
+			if( ! LoadSystem( &sd, argv[i+1] ) )
+				return 1;
+			return WriteSystemBinary( &sd, argv[i+2] ) ? 0 : 1;
+		}
+
+		if( strcmp( argv[i], "-beltbench" ) == 0 )
+		{
+			int n = ( i+1 < argc  &&  isdigit( argv[i+1][0] ) ) ? atoi( argv[i+1] ) : 1000000;
+			struct ParticleBelt belt;
+			InitBelt( &belt, n, 2.1f, 3.3f, .2f, 15.f, 0., 1.f, 1.f, 1.f );
+			BeltBenchmark( &belt, stdout );
+			return 0;
+		}
+
+		if( strcmp( argv[i], "-sweep" ) == 0 )
+		{
+			int n = ( i+1 < argc  &&  isdigit( argv[i+1][0] ) ) ? atoi( argv[i+1] ) : DEFAULT_SWEEP_TOURS;
+			RunSweep( n, stdout );
+			return 0;
+		}
+
+		if( strcmp( argv[i], "-makeephem" ) == 0  &&  i+3 < argc )
+		{
+			int y0, m0, d0, y1, m1, d1;
+			if( sscanf( argv[i+2], "%d-%d-%d", &y0, &m0, &d0 ) != 3  ||  sscanf( argv[i+3], "%d-%d-%d", &y1, &m1, &d1 ) != 3 )
+			{
+				fprintf( stderr, "-makeephem wants FILE YYYY-MM-DD YYYY-MM-DD\n" );
+				return 1;
+			}
+
+			// body k in the file is ephemeris slot k:
+			bool ok = MakeChebyshevFile( &PlanetEphemeris, JulianDate( y0, m0, (double)d0 ), JulianDate( y1, m1, (double)d1 ),
+										 CHEBY_DEFAULT_DAYS, CHEBY_DEFAULT_COEFFS, System.numBodies, SystemChecksum( &System ), argv[i+1] );
+			return ok ? 0 : 1;
+		}
+	}
+
 	// turn on the glut package:
 	// (do this before checking argc and argv since it might
 	// pull some command line arguments out)
 
 	glutInit( &argc, argv );
 
+	for( int i = 1; i < argc; i++ )
+	{
+		if( strcmp( argv[i], "-fps" ) == 0  &&  i+1 < argc )
+		{
+			TargetFPS = atoi( argv[++i] );
+			if( TargetFPS < 1 )
+				TargetFPS = DEFAULT_TARGET_FPS;
+		}
+		else if( strcmp( argv[i], "-truescale" ) == 0 )
+		{
+			DistanceScale = RadiusScale;		// distances and radii at the same scale
+		}
+		else if( strcmp( argv[i], "-reversedz" ) == 0 )
+		{
+			ReversedZOn = true;
+		}
+		else if( strcmp( argv[i], "-system" ) == 0  &&  i+1 < argc )
+		{
+			i++;		// already loaded
+		}
+		else if( strcmp( argv[i], "-ephem" ) == 0  &&  i+1 < argc )
+		{
+			// on failure the elements are used:
+			OpenChebyshevFile( &PlanetCache, &PlanetEphemeris, System.numBodies, SystemChecksum( &System ), argv[++i] );
+		}
+		else if( strcmp( argv[i], "-threads" ) == 0  &&  i+1 < argc )
+		{
+			i++;		// already parsed
+		}
+		else if( strcmp( argv[i], "-metrics" ) == 0  &&  i+1 < argc )
+		{
+			MetricsStart( argv[++i] );
+		}
+		else if( strcmp( argv[i], "-perf" ) == 0 )
+		{
+			PerfStart( );		// this is the thread that draws
+		}
+		else if( strcmp( argv[i], "-trace" ) == 0  &&  i+1 < argc )
+		{
+#ifdef ENABLE_TRACE
+			TraceStart( argv[++i] );
+			TRACE_THREAD_NAME( "main" );
+#else
+			fprintf( stderr, "-trace: tracing was compiled out (see ENABLE_TRACE in trace.cpp)\n" );
+			i++;
+#endif
+		}
+		else if( strcmp( argv[i], "-scenarios" ) == 0  &&  i+1 < argc )
+		{
+			ScenarioFile = argv[++i];
+			if( ! ReadScenarios( ScenarioFile, &System, &Scenarios ) )
+				return 1;
+		}
+		else if( strcmp( argv[i], "-baseline" ) == 0  &&  i+1 < argc )
+		{
+			ScenarioBaseline = argv[++i];
+		}
+		else if( strcmp( argv[i], "-savebaseline" ) == 0  &&  i+1 < argc )
+		{
+			ScenarioSaveBaseline = argv[++i];
+		}
+		else if( ( strcmp( argv[i], "-golden" ) == 0  ||  strcmp( argv[i], "-savegolden" ) == 0 )  &&  i+1 < argc )
+		{
+			GoldenSave = argv[i][1] == 's';
+			GoldenDir = argv[++i];
+		}
+		else if( strcmp( argv[i], "-video" ) == 0  &&  i+1 < argc )
+		{
+			VideoFile = argv[++i];
+		}
+		else if( strcmp( argv[i], "-psnr" ) == 0  &&  i+1 < argc )
+		{
+			GoldenPsnr = atof( argv[++i] );
+		}
+		else if( strcmp( argv[i], "-size" ) == 0  &&  i+1 < argc )
+		{
+			if( sscanf( argv[++i], "%dx%d", &OffscreenWidth, &OffscreenHeight ) != 2  ||  OffscreenWidth < 1  ||  OffscreenHeight < 1 )
+			{
+				fprintf( stderr, "-size wants WIDTHxHEIGHT, not '%s'\n", argv[i] );
+				OffscreenWidth = OffscreenHeight = DEFAULT_OFFSCREEN_SIZE;
+			}
+		}
+		else if( strcmp( argv[i], "-stars" ) == 0  &&  i+1 < argc )
+		{
+			NumStars = atoi( argv[++i] );
+			if( NumStars < 1 )
+				NumStars = NUM_STARS;
+		}
+		else if( strcmp( argv[i], "-belts" ) == 0  &&  i+1 < argc )
+		{
+			BeltBodies = atoi( argv[++i] );
+			if( BeltBodies < 0 )
+				BeltBodies = 0;
+		}
+		else if( strcmp( argv[i], "-date" ) == 0  &&  i+1 < argc )
+		{
+			i++;		// already parsed
+		}
+		else
+			fprintf( stderr, "Unknown command line argument: '%s'\n", argv[i] );
+	}
+
+	// start the job system before anything hands it work:
+
+	JobsStart( &Jobs, JobThreads );
+	FrameArenasInit( Jobs.arenas, Jobs.numThreads, FRAME_ARENA_BYTES );
+	InitFrameGraphs( );
+
+	// publish the starting state, so there is a snapshot to set up and draw from:
+
+	TripleBufferInit( &SimSnapshots );
+	SimInit( &Sim );
+	SimPublish( );
+	SimFrame = TripleBufferRead( &SimSnapshots );
+
 	// setup all the graphics stuff:
 
 	InitGraphics( );
@@ -325,6 +705,23 @@ main( int argc, char *argv[ ] )
 
 	InitMenus( );
 
+	// from here on, only the simulation thread touches the simulation's globals --
+	// unless scenarios are to be run, which step the simulation themselves:
+
+	if( GoldenDir != NULL  &&  ScenarioFile == NULL )
+		fprintf( stderr, "-golden and -savegolden check the frames -scenarios captures, so they need it\n" );
+	if( VideoFile != NULL  &&  ScenarioFile == NULL )
+		fprintf( stderr, "-video renders the tour -scenarios scripts, so it needs it\n" );
+	if( ScenarioFile != NULL )
+	{
+		glutTimerFunc( 0, ScenarioTimer, 0 );
+	}
+	else
+	{
+		SimQuit = false;
+		SimThread = std::thread( SimThreadMain );
+	}
+
 	// draw the scene once and wait for some interaction:
 	// (this will never return)
 
@@ -338,8 +735,7 @@ main( int argc, char *argv[ ] )
 }
 
 
-// this is where one would put code that is to be called
-// everytime the glut main loop has nothing to do
+// this is called from FrameTimer( ) once per paced frame
 //
 // this is typically where animation parameters are set
 //
@@ -351,6 +747,8 @@ Animate( )
 	// put animation stuff in here -- change some global variables
 	// for Display( ) to find:
 
+	TRACE_ZONE("Animate");
+
 	/*
 	float Time;
 	#define MS_PER_CYCLE	20000
@@ -361,9 +759,9 @@ Animate( )
 
 	//RotateAngle = 360. * Time;
 	*/
-	float ms2 = glutGet(GLUT_ELAPSED_TIME);
-	travel = travel + velocity * (ms2 - PreviousMS);
-	PreviousMS = ms2;
+	SimFrame = TripleBufferRead(&SimSnapshots);	// the newest tick; the simulation thread has moved on
+	LatencyPickup(SimFrame->inputsApplied, SimFrame->appliedAt, SimFrame->published);
+	JobGraphRun(&AnimateGraph);		// planets and belts, side by side
 
 
 	// force a call to Display( ) next time it is convenient:
@@ -381,11 +779,28 @@ Display()
 	// set which window we want to do the graphics into:
 
 	glutSetWindow(MainWindow);
+	TRACE_ZONE("Display");
+	std::chrono::steady_clock::time_point displayStart = std::chrono::steady_clock::now();
+
+
+	// last frame's scratch memory is all free now:
+
+	FrameArenasReset();
+	MemCheck(false);
+
+
+	// the hud font atlas is rendered through the back buffer, so build it before erasing:
+
+	if (!GlyphAtlasTried)
+		BuildGlyphAtlas(GLUT_BITMAP_TIMES_ROMAN_24);
 
 
 	// erase the background:
+	// (reversed-z only applies to the perspective projection)
 
-	glDrawBuffer(GL_BACK);
+	bool reversedZ = ReversedZOn && WhichProjection == PERSP && BeginReversedZ();
+	if (!reversedZ)
+		BindFrameTarget();
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 	glEnable(GL_DEPTH_TEST);
@@ -402,8 +817,8 @@ Display()
 
 	// set the viewport to a square centered in the window:
 
-	GLsizei vx = glutGet(GLUT_WINDOW_WIDTH);
-	GLsizei vy = glutGet(GLUT_WINDOW_HEIGHT);
+	GLsizei vx = FrameWidth();
+	GLsizei vy = FrameHeight();
 	GLsizei v = vx < vy ? vx : vy;			// minimum dimension
 	GLint xl = (vx - v) / 2;
 	GLint yb = (vy - v) / 2;
@@ -418,9 +833,11 @@ Display()
 	glMatrixMode(GL_PROJECTION);
 	glLoadIdentity();
 	if (WhichProjection == ORTHO)
-		glOrtho(-2.f, 2.f, -2.f, 2.f, 0.1f, 1000.f);
+		glOrtho(-2.f, 2.f, -2.f, 2.f, NEAR_PLANE, FAR_PLANE);
+	else if (reversedZ)
+		LoadInfiniteReversedPerspective(70.f, 1.f, NEAR_PLANE);
 	else
-		gluPerspective(70.f, 1.f, 0.1f, 1000.f);
+		gluPerspective(70.f, 1.f, NEAR_PLANE, FAR_PLANE);
 
 
 	// place the objects into the scene:
@@ -447,6 +864,15 @@ Display()
 	glScalef((GLfloat)Scale, (GLfloat)Scale, (GLfloat)Scale);
 
 
+	// get the view frustum, in the ship-relative coordinates everything below is placed in:
+
+	FrustumFromGL(&ViewFrustum, !reversedZ);
+	memset(&Stats, 0, sizeof(Stats));
+	glGetDoublev(GL_PROJECTION_MATRIX, PickProjection);
+	glGetDoublev(GL_MODELVIEW_MATRIX, PickModelview);
+	glGetIntegerv(GL_VIEWPORT, PickViewport);
+
+
 	// set the fog parameters:
 
 	if (DepthCueOn != 0)
@@ -476,119 +902,132 @@ Display()
 	glEnable(GL_NORMALIZE);
 
 	
-	glLightModelfv(GL_LIGHT_MODEL_AMBIENT, MulArray3(.3f, White));
+	glLightModelfv(GL_LIGHT_MODEL_AMBIENT, MulArray3(.3f, White).v);
 	glLightModeli(GL_LIGHT_MODEL_TWO_SIDE, GL_TRUE);
 
 	glEnable(GL_LIGHTING);
 	glEnable(GL_LIGHT0);
 	//SetMaterial(.44, .5, .56, 100.);
 
+	// POSE THE SHIP AND BODIES ---------------------------------------------------------------
+	// interpolate between the last two simulation ticks:
+	// everything is positioned relative to the ship on the cpu, so there is no big glTranslatef( )
+
+	// the snapshot's tick happened when it was published, so we are that far toward the next one:
+	double alpha = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - SimFrame->published).count() / SIM_TICK_MS;
+	if (alpha > 1. || FixedStep)
+		alpha = 1.;
+	RenderTravel = SimFrame->prevTravel + (SimFrame->travel - SimFrame->prevTravel) * alpha;
+	TRACE_BEGIN(cullZone, "pose and cull");
+	JobGraphRun(&CullGraph);		// pose everything, refit the bvh and cull, before any drawing
+
+	TRACE_END(cullZone);
+
 	// DRAW SPACESHIP -------------------------------------------------------------------------
-	
-	glPushMatrix();
-	glRotatef(96, 0., 1., 0.); // align spaceship direction with planets
 
-	// flip spaceship to forward facing if changing from deceleration to acceleration; set as back-facing if the reverse
-	if (FlipSpaceship) {
-		if (ForwardDirection) {
-			glRotatef(-360, 0., 1., 0.);
-		}
-		else {
-			glRotatef(180., 0., 1., 0.);
-		}
-	}
+	TRACE_BEGIN(shipZone, "draw ship");
+
+	// each part is culled with a sphere around it, in the part's own frame
 
 	// spaceship main body
-	gluCylinder(gluNewQuadric(), .25, .25, 1., 30., 30.);
+	if (ShipPartVisible(ShipBodyNode, .5f, .56f)) {
+		glPushMatrix();
+		glMultMatrixf(Scene.scene[ShipBodyNode]);
+		glRotatef(90., 1., 0., 0.);		// OsuCone( ) is built along +y, the ship along +z
+		OsuCone(.25, .25, 1., 30, 30, false);
+		glPopMatrix();
+	}
 
 	// engine section between body and vent
-	glPushMatrix();
-		glEnable(GL_TEXTURE_2D);
-		glBindTexture(GL_TEXTURE_2D, SpaceshipTex);
-		glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
-		//SetMaterial(.44, .5, .56, 100.);
-		glTranslatef(0., 0., -.05);
-		//glColor3f(.44, .5, .56);
-		OsuTorus(.14, .25, 30., 30.);
-		glDisable(GL_TEXTURE_2D);
-	glPopMatrix();
+	if (ShipPartVisible(ShipEngineNode, 0.f, .39f)) {
+		glPushMatrix();
+			glMultMatrixf(Scene.scene[ShipEngineNode]);
+			glEnable(GL_TEXTURE_2D);
+			glBindTexture(GL_TEXTURE_2D, SpaceshipTex);
+			glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+			OsuTorus(.14, .25, 30., 30.);
+			glDisable(GL_TEXTURE_2D);
+		glPopMatrix();
+	}
 	glEnable(GL_LIGHTING);
 	
 	// spaceship engine vent
+	glEnable(GL_LIGHT1);
 	glPushMatrix();
-		glEnable(GL_LIGHT1);
-		glPushMatrix();
-			glTranslatef(0., 0., -.1);
-			// draw lighting - changes based on engine output
-			float lightPos[] = { 0., 0., -.5 };
-			glLightfv(GL_LIGHT1, GL_POSITION, lightPos);
-			float ambient[] = { EngineAmbient, 0, 0, 1. };
-			float diffuse[] = { EngineDiffuse, 0, 0, 1. };
-			float specular[] = { EngineSpecular, 0., 0., 1. };
-			glLightfv(GL_LIGHT1, GL_AMBIENT, ambient);
-			glLightfv(GL_LIGHT1, GL_DIFFUSE, diffuse);
-			glLightfv(GL_LIGHT1, GL_SPECULAR, specular);
-			glLightf(GL_LIGHT1, GL_CONSTANT_ATTENUATION, 0.);
-			glLightf(GL_LIGHT1, GL_LINEAR_ATTENUATION, 0.);
-			glLightf(GL_LIGHT1, GL_QUADRATIC_ATTENUATION, 1.);
+		glMultMatrixf(Scene.scene[ShipVentLightNode]);
+		// draw lighting - changes based on engine output
+		float lightPos[] = { 0., 0., -.5 };
+		glLightfv(GL_LIGHT1, GL_POSITION, lightPos);
+		float ambient[] = { SimFrame->engineAmbient, 0, 0, 1. };
+		float diffuse[] = { SimFrame->engineDiffuse, 0, 0, 1. };
+		float specular[] = { SimFrame->engineSpecular, 0., 0., 1. };
+		glLightfv(GL_LIGHT1, GL_AMBIENT, ambient);
+		glLightfv(GL_LIGHT1, GL_DIFFUSE, diffuse);
+		glLightfv(GL_LIGHT1, GL_SPECULAR, specular);
+		glLightf(GL_LIGHT1, GL_CONSTANT_ATTENUATION, 0.);
+		glLightf(GL_LIGHT1, GL_LINEAR_ATTENUATION, 0.);
+		glLightf(GL_LIGHT1, GL_QUADRATIC_ATTENUATION, 1.);
+		if (ShipPartVisible(ShipVentLightNode, 0.f, .01f))		// the light stays on either way
 			OsuSphere(.01, 10., 10.);
-		glPopMatrix();
-		glTranslatef(0., 0., -.25);
-		gluCylinder(gluNewQuadric(), .15, 0., .25, 30., 30.);
 	glPopMatrix();
+	if (ShipPartVisible(ShipVentConeNode, .125f, .2f)) {
+		glPushMatrix();
+			glMultMatrixf(Scene.scene[ShipVentConeNode]);
+			glRotatef(90., 1., 0., 0.);
+			OsuCone(.15, 0., .25, 30, 30, false);
+		glPopMatrix();
+	}
 
 	// spaceship nose
-	glTranslatef(0., 0., 1.);
-	gluCylinder(gluNewQuadric(), .25, 0., 1., 30., 30.);
-	glPopMatrix();
+	if (ShipPartVisible(ShipNoseNode, .5f, .56f)) {
+		glPushMatrix();
+		glMultMatrixf(Scene.scene[ShipNoseNode]);
+		glRotatef(90., 1., 0., 0.);
+		OsuCone(.25, 0., 1., 30, 30, false);
+		glPopMatrix();
+	}
 
 	
 
 
 
+	TRACE_END(shipZone);
+
 	// DRAW STARS -----------------------------------------------------------------------------------------
 
-	DrawStars(NUM_STARS);
+	TRACE_BEGIN(starsZone, "draw stars");
+	PerfBegin(PERF_PHASE_STARS);
+	DrawStars(NumStars);
+	PerfEnd(PERF_PHASE_STARS, Stats.starsDrawn);
+	TRACE_END(starsZone);
 
 
 	// DRAW SUN AND PLANETS -------------------------------------------------------------------------------
-	glTranslatef(-travel, 0, 0); // use animation() to move objects
 	
 	glEnable(GL_TEXTURE_2D);
 
-	// SOL
-	glPushMatrix();
-	
+	// SUN AND PLANETS
 	glEnable(GL_LIGHTING);
-	DrawSun(Sun);
-	
-	// MERCURY
-	DrawPlanet(Mercury, 0, 1);
-
-	// VENUS
-	DrawPlanet(Venus, 0, -1.2);
-
-	// EARTH
-	DrawPlanet(Earth, 0, -1.5);
-	
-	// MARS
-	DrawPlanet(Mars, .2, -1);
-	
-	// JUPITER
-	DrawPlanet(Jupiter, -.4, 5);
-
-	// SATURN
-	DrawPlanet(Saturn, 0, -6);
-
-	// URANUS
-	DrawPlanet(Uranus, .3, -3);
-
-	// NEPTUNE
-	DrawPlanet(Neptune, 0, 2);
+	TRACE_BEGIN(bodiesZone, "draw bodies");
+	long long spherePoints = OsuSpherePoints;
+	PerfBegin(PERF_PHASE_BODIES);
+	DrawSun(SunIndex);
+	for (int i = 0; i < Bodies.n; i++) {
+		if (i != SunIndex)
+			DrawPlanet(i);
+	}
+	PerfEnd(PERF_PHASE_BODIES, OsuSpherePoints - spherePoints);
+	TRACE_END(bodiesZone);
+
+	// ASTEROID AND KUIPER BELTS
+	TRACE_BEGIN(beltsZone, "draw belts");
+	PerfBegin(PERF_PHASE_BELTS);
+	int beltBodiesDrawn = DrawBelts();
+	PerfEnd(PERF_PHASE_BELTS, beltBodiesDrawn);
+	TRACE_END(beltsZone);
 	
 	
 	glDisable(GL_TEXTURE_2D);
-	glPopMatrix();
 
 	glDisable(GL_NORMALIZE);
 	
@@ -631,11 +1070,46 @@ Display()
 	glLoadIdentity( );
 	glColor3f( 1.f, 1.f, 1.f );
 
-	setVelocityText(); // set initial velocity text
+	TRACE_BEGIN(hudZone, "hud");
+	setVelocityText(v);
+	if (StatsOn)
+		setStatsText(v);
+	if (PickedItem >= 0)
+		setPickText(v);
+	TRACE_END(hudZone);
+
+	if (reversedZ)
+		EndReversedZ();
 
 	// swap the double-buffered framebuffers:
 
-	glutSwapBuffers( );
+	if( RenderTarget != NULL )
+	{
+		glBindFramebuffer( GL_FRAMEBUFFER, 0 );		// nothing to show: the caller reads it back
+	}
+	else
+	{
+		TRACE_BEGIN(swapZone, "swap");
+		glutSwapBuffers( );
+		TRACE_END(swapZone);
+	}
+	LatencySwapped( );
+	if( !LatencyTimerArmed && LatencyPoll( ) )
+	{
+		LatencyTimerArmed = true;
+		glutTimerFunc( 1, LatencyTimer, 0 );		// watch for the gpu to finish this frame
+	}
+
+	if( MetricsOn )
+	{
+		MetricsDrawn( METRIC_DRAWN_BODIES, Stats.bodiesDrawn, Stats.bodiesTotal );
+		MetricsDrawn( METRIC_DRAWN_PARTS, Stats.partsDrawn, Stats.partsTotal );
+		MetricsDrawn( METRIC_DRAWN_STARS, Stats.starsDrawn, Stats.starsTotal );
+		MetricsDrawn( METRIC_DRAWN_CHUNKS, Stats.chunksDrawn, Stats.chunksTotal );
+		MetricsDrawn( METRIC_DRAWN_CLUSTERS, Stats.clustersDrawn, Stats.clustersTotal );
+		MetricsShip( RenderTravel, SimFrame->velocity, SimFrame->lightSpeedMultiple );
+		MetricsFrame( displayStart );
+	}
 
 	// be sure the graphics buffer has been sent:
 	// note: be sure to use glFlush( ) here, not glFinish( ) !
@@ -681,17 +1155,26 @@ DoMainMenu( int id )
 	switch( id )
 	{
 		case LIGHT:
-			GoLightSpeed();
+			PostSimCommand(SIM_LIGHTSPEED);
+			WakeAnimation();
 			break;
 	
 		case RESET:
 			Reset( );
+			WakeAnimation( );		// so the reset tick gets drawn
 			break;
 
 		case QUIT:
 			// gracefully close out the graphics:
 			// gracefully close the graphics window:
 			// gracefully exit the program:
+			MemReport( stderr );
+			if( PerfOn )
+				PerfReport( stderr );
+			if( LatencyQueuedSeq > 0 )
+				LatencyReport( stderr );
+			StopThreads( );
+			TraceWrite( );
 			glutSetWindow( MainWindow );
 			glFinish( );
 			glutDestroyWindow( MainWindow );
@@ -817,6 +1300,8 @@ InitMenus( )
 void
 InitGraphics( )
 {
+	TRACE_ZONE( "InitGraphics" );
+
 	// request the display modes:
 	// ask for red-green-blue-alpha color, double-buffering, and z-buffering:
 
@@ -878,38 +1363,16 @@ InitGraphics( )
 	glutMenuStateFunc( NULL );
 	glutTimerFunc( -1, NULL, 0 );
 
-	// setup glut to call Animate( ) every time it has
-	// 	nothing it needs to respond to (which is most of the time)
-	// we don't need to do this for this program, and really should set the argument to NULL
-	// but, this sets us up nicely for doing animation
+	// don't spin in an idle callback -- FrameTimer( ) calls Animate( ) at TargetFPS
+	// and only while something is actually moving:
 
-	glutIdleFunc( Animate );
+	glutIdleFunc( NULL );
 
-	int	WidthSun, HeightSun, WidthMercury, HeightMercury, WidthVenus, HeightVenus, WidthEarth, HeightEarth, WidthMars, HeightMars, WidthJupiter, HeightJupiter, WidthSaturn, HeightSaturn, WidthUranus, HeightUranus, WidthNeptune, HeightNeptune, WidthShip, HeightShip;
+	int	WidthShip, HeightShip;
 
 	// read in textures
+	TRACE_BEGIN(shipTextureZone, "load ship texture");
 	spaceshipTexture = BmpToTexture("Solar_system/spaceship2.bmp", &WidthShip, &HeightShip);
-	sunTexture = BmpToTexture("Solar_system/2k_sun.bmp", &WidthSun, &HeightSun);
-	venusTexture = BmpToTexture("Solar_system/4k_venus_atmosphere.bmp", &WidthVenus, &HeightVenus);
-	texture = BmpToTexture("Solar_system/worldtex.bmp", &WidthEarth, &HeightEarth);
-	uranusTexture = BmpToTexture("Solar_system/2k_uranus.bmp", &WidthUranus, &HeightUranus);
-	neptuneTexture = BmpToTexture("Solar_system/2k_neptune.bmp", &WidthNeptune, &HeightNeptune);
-	
-
-	if (WhichTexture == NORMAL) {
-		// use 2k res
-		mercuryTexture = BmpToTexture("Solar_system/2k_mercury.bmp", &WidthMercury, &HeightMercury);
-		marsTexture = BmpToTexture("Solar_system/2k_mars.bmp", &WidthMars, &HeightMars);
-		jupiterTexture = BmpToTexture("Solar_system/2k_jupiter.bmp", &WidthJupiter, &HeightJupiter);
-		saturnTexture = BmpToTexture("Solar_system/2k_saturn.bmp", &WidthSaturn, &HeightSaturn);
-	}
-	else {
-		// use 8k if possible
-		mercuryTexture = BmpToTexture("Solar_system/8k_mercury.bmp", &WidthMercury, &HeightMercury);
-		marsTexture = BmpToTexture("Solar_system/8k_mars.bmp", &WidthMars, &HeightMars);
-		jupiterTexture = BmpToTexture("Solar_system/8k_jupiter.bmp", &WidthJupiter, &HeightJupiter);
-		saturnTexture = BmpToTexture("Solar_system/8k_saturn.bmp", &WidthSaturn, &HeightSaturn);
-	}
 
 	int level = 0, ncomps = 3, border = 0;
 	
@@ -917,16 +1380,6 @@ InitGraphics( )
 
 	// assign binding handles
 	glGenTextures(1, &SpaceshipTex);
-	glGenTextures(1, &SunTex);
-	glGenTextures(1, &MercuryTex);
-	glGenTextures(1, &VenusTex);
-	glGenTextures(1, &EarthTex);
-	glGenTextures(1, &MarsTex); 
-	glGenTextures(1, &JupiterTex);
-	glGenTextures(1, &SaturnTex);
-	glGenTextures(1, &UranusTex);
-	glGenTextures(1, &NeptuneTex);
-	
 
 	// texture spaceship
 	glBindTexture(GL_TEXTURE_2D, SpaceshipTex);
@@ -935,123 +1388,23 @@ InitGraphics( )
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexImage2D(GL_TEXTURE_2D, level, ncomps, WidthShip, HeightShip, border, GL_RGB, GL_UNSIGNED_BYTE, spaceshipTexture);
+	MemAdd(MEM_TEXTURES_GPU, 4LL * WidthShip * HeightShip);		// drivers keep rgb as rgba
+	TheMetrics.textures++;
+	TRACE_END(shipTextureZone);
 
-	// make Sol texture current and set its parameters
-	glBindTexture(GL_TEXTURE_2D, SunTex);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexImage2D(GL_TEXTURE_2D, level, ncomps, WidthSun, HeightSun, border, GL_RGB, GL_UNSIGNED_BYTE, sunTexture);
-
-	// make Mercury texture current and set its parameters
-	glBindTexture(GL_TEXTURE_2D, MercuryTex);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexImage2D(GL_TEXTURE_2D, level, ncomps, WidthMercury, HeightMercury, border, GL_RGB, GL_UNSIGNED_BYTE, mercuryTexture);
-	
-	// make Venus texture current and set its parameters
-	glBindTexture(GL_TEXTURE_2D, VenusTex);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexImage2D(GL_TEXTURE_2D, level, ncomps, WidthVenus, HeightVenus, border, GL_RGB, GL_UNSIGNED_BYTE, venusTexture);
-
-	// make Earth texture current and set its parameters
-	glBindTexture(GL_TEXTURE_2D, EarthTex);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexImage2D(GL_TEXTURE_2D, level, ncomps, WidthEarth, HeightEarth, border, GL_RGB, GL_UNSIGNED_BYTE, texture);
-
-	// make Mars texture current and set its parameters
-	glBindTexture(GL_TEXTURE_2D, MarsTex);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexImage2D(GL_TEXTURE_2D, level, ncomps, WidthMars, HeightMars, border, GL_RGB, GL_UNSIGNED_BYTE, marsTexture);
-
-	// make Jupiter texture current and set its parameters
-	glBindTexture(GL_TEXTURE_2D, JupiterTex);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexImage2D(GL_TEXTURE_2D, level, ncomps, WidthJupiter, HeightJupiter, border, GL_RGB, GL_UNSIGNED_BYTE, jupiterTexture);
-
-	// make Saturn texture current and set its parameters
-	glBindTexture(GL_TEXTURE_2D, SaturnTex);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexImage2D(GL_TEXTURE_2D, level, ncomps, WidthSaturn, HeightSaturn, border, GL_RGB, GL_UNSIGNED_BYTE, saturnTexture);
-
-	// make Uranus texture current and set its parameters
-	glBindTexture(GL_TEXTURE_2D, UranusTex);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexImage2D(GL_TEXTURE_2D, level, ncomps, WidthUranus, HeightUranus, border, GL_RGB, GL_UNSIGNED_BYTE, uranusTexture);
-
-	// make Neptune texture current and set its parameters
-	glBindTexture(GL_TEXTURE_2D, NeptuneTex);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexImage2D(GL_TEXTURE_2D, level, ncomps, WidthNeptune, HeightNeptune, border, GL_RGB, GL_UNSIGNED_BYTE, neptuneTexture);
-
-	Sun.solar_distance = -25000000.; // modified for convenience
-	Sun.radius = 432690;
-	Sun.texture_name = SunTex;
-
-	Mercury.solar_distance = 35000000.;
-	Mercury.radius = 1516;
-	Mercury.texture_name = MercuryTex;
-
-	Venus.solar_distance = 67000000.;
-	Venus.radius = 3760;
-	Venus.texture_name = VenusTex;
-
-	Earth.solar_distance = 93000000.;
-	Earth.radius = 3959;
-	Earth.texture_name = EarthTex;
+	// the sun and planets, from the system description
+	LoadBodyTextures();
 
-	Mars.solar_distance = 142000000.;
-	Mars.radius = 2106;
-	Mars.texture_name = MarsTex;
+	InitScene();
+	UpdatePlanetPositions();	// -date has been parsed by now
+	InitBelts();
 
-	Jupiter.solar_distance = 484000000.;
-	Jupiter.radius = 43441;
-	Jupiter.rotate_angle = 180;
-	Jupiter.texture_name = JupiterTex;
-
-	Saturn.solar_distance = 889000000.;
-	Saturn.radius = 36184;
-	Saturn.texture_name = SaturnTex;
-
-	Uranus.solar_distance = 1790000000.;
-	Uranus.radius = 15759;
-	Uranus.texture_name = UranusTex;
-
-	Neptune.solar_distance = 2880000000.;
-	Neptune.radius = 15299;
-	Neptune.rotate_angle = 180;
-	Neptune.texture_name = NeptuneTex;
-
-	getRandomStarLocations(NUM_STARS);
+	getRandomStarLocations(NumStars);
+	MemAdd(MEM_STARS, sizeof(StarChunkFirst));
 
 
 	// init the glew package (a window must be open to do this):
 
-#ifdef WIN32
 	GLenum err = glewInit( );
 	if( err != GLEW_OK )
 	{
@@ -1060,7 +1413,10 @@ InitGraphics( )
 	else
 		fprintf( stderr, "GLEW initialized OK\n" );
 	fprintf( stderr, "Status: Using GLEW %s\n", glewGetString(GLEW_VERSION));
-#endif
+
+	ReversedZSupported = err == GLEW_OK  &&  GLEW_ARB_clip_control  &&  GLEW_ARB_framebuffer_object  &&  GLEW_ARB_depth_buffer_float;
+	if( ReversedZOn  &&  !ReversedZSupported )
+		fprintf( stderr, "Reversed-Z is not supported here, using the standard depth buffer\n" );
 
 }
 
@@ -1106,17 +1462,17 @@ Keyboard( unsigned char c, int x, int y )
 	{
 		
 		case 'v':
-			printf("velocity: %f\n", velocity);
+			printf("velocity: %f\n", SimFrame->velocity);
 			break;
 	
 		case 'w':
 		case 'W':
-			IncreaseVelocity();
+			PostSimCommand(SIM_FASTER);
 			break;
 
 		case 'S':
 		case 's':
-			DecreaseVelocity();
+			PostSimCommand(SIM_SLOWER);
 			break;
 
 		case 'p':
@@ -1124,6 +1480,18 @@ Keyboard( unsigned char c, int x, int y )
 			WhichProjection = PERSP;
 			break;
 
+		case 'i':
+		case 'I':
+			StatsOn = !StatsOn;
+			break;
+
+		case 'z':
+		case 'Z':
+			ReversedZOn = !ReversedZOn;
+			if (ReversedZOn && !ReversedZSupported)
+				fprintf(stderr, "Reversed-Z needs GL_ARB_clip_control, GL_ARB_framebuffer_object and GL_ARB_depth_buffer_float\n");
+			break;
+
 		case 'q':
 		case 'Q':
 		case ESCAPE:
@@ -1134,8 +1502,9 @@ Keyboard( unsigned char c, int x, int y )
 			fprintf( stderr, "Don't know what to do with keyboard hit: '%c' (0x%0x)\n", c, c );
 	}
 
-	// force a call to Display( ):
+	// force a call to Display( ) and make sure queued commands get a tick:
 
+	WakeAnimation( );
 	glutSetWindow( MainWindow );
 	glutPostRedisplay( );
 }
@@ -1157,7 +1526,13 @@ MouseButton( int button, int state, int x, int y )
 	switch( button )
 	{
 		case GLUT_LEFT_BUTTON:
-			b = LEFT;		break;
+			b = LEFT;
+			if( state == GLUT_DOWN  &&  ( glutGetModifiers( ) & GLUT_ACTIVE_SHIFT ) != 0 )
+			{
+				PickAt( x, y );		// shift-click selects instead of rotating
+				b = 0;
+			}
+			break;
 
 		case GLUT_MIDDLE_BUTTON:
 			b = MIDDLE;		break;
@@ -1230,8 +1605,13 @@ MouseMotion( int x, int y )
 	Xmouse = x;			// new current position
 	Ymouse = y;
 
-	glutSetWindow( MainWindow );
-	glutPostRedisplay( );
+	// passive motion changes nothing on the screen:
+
+	if( ActiveButton != 0 )
+	{
+		glutSetWindow( MainWindow );
+		glutPostRedisplay( );
+	}
 }
 
 
@@ -1253,12 +1633,7 @@ Reset( )
 	WhichColor = WHITE;
 	WhichProjection = PERSP;
 	Xrot = Yrot = 0.;
-	travel = 0;
-	velocity = 0;
-	RedShift[1] = 1.;
-	RedShift[2] = 1.;
-	BlueShift[0] = 1.;
-	BlueShift[1] = 1.;
+	PostSimCommand(SIM_RESET);		// the simulation resets its own state
 }
 
 
@@ -1283,17 +1658,16 @@ Visibility ( int state )
 	if( DebugOn != 0 )
 		fprintf( stderr, "Visibility: %d\n", state );
 
-	if( state == GLUT_VISIBLE )
+	WindowVisible = ( state == GLUT_VISIBLE );
+	if( WindowVisible )
 	{
+		WakeAnimation( );
 		glutSetWindow( MainWindow );
 		glutPostRedisplay( );
 	}
-	else
-	{
-		// could optimize by keeping track of the fact
-		// that the window is not visible and avoid
-		// animating or redrawing it ...
-	}
+
+	// else: the pending FrameTimer( ) sees WindowVisible is false and lets the
+	// simulation and the redraws lapse until we become visible again
 }
 
 
@@ -1415,7 +1789,7 @@ struct bmfh
 	short bfReserved1;
 	short bfReserved2;
 	int bfOffBytes;		// # bytes to get to the start of the per-pixel data
-} FileHeader;
+};
 
 // bmp info header:
 struct bmih
@@ -1431,7 +1805,7 @@ struct bmih
 	int biYPixelsPerMeter;
 	int biClrUsed;		// # colors in the palette
 	int biClrImportant;
-} InfoHeader;
+};
 
 
 
@@ -1440,6 +1814,8 @@ struct bmih
 unsigned char *
 BmpToTexture( char *filename, int *width, int *height )
 {
+	struct bmfh FileHeader;		// locals, so textures can be decoded on several threads at once
+	struct bmih InfoHeader;
 	FILE *fp;
 #ifdef _WIN32
         errno_t err = fopen_s( &fp, filename, "rb" );
@@ -1516,6 +1892,7 @@ BmpToTexture( char *filename, int *width, int *height )
 		fprintf( stderr, "Cannot allocate the texture array!\n" );
 		return NULL;
 	}
+	MemAdd( MEM_TEXTURES, 3 * nums * numt );
 
 	// extra padding bytes:
 
@@ -1746,71 +2123,89 @@ Unit(float vin[3], float vout[3])
 	return dist;
 }
 
+// convert a world position (miles) to ship-relative scene units:
+// the subtraction is done in double so precision doesn't depend on how far the ship has gone
+
+void
+WorldToScene(double wx, double wy, double wz, float out[3])
+{
+	out[0] = (float)((wx - RenderTravel) / DistanceScale);
+	out[1] = (float)(wy / DistanceScale);
+	out[2] = (float)(wz / DistanceScale);
+}
+
 void
-DrawPlanet(struct Solar_System_Obj planet, float y_dist, float z_dist)
+DrawPlanet(int i)
 {
-	glBindTexture(GL_TEXTURE_2D, planet.texture_name);
+	if (!BodyVisible(i))
+		return;
+
+	glBindTexture(GL_TEXTURE_2D, Bodies.texture[i]);
 	glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
 	
-	planet.distance_scaled = (float)planet.solar_distance / DISTANCE_SCALE_FACTOR;
-	planet.radius_scaled = (float)planet.radius / RADIUS_SCALE_FACTOR;
 	glPushMatrix();
-	glTranslatef(planet.distance_scaled, y_dist, z_dist);
-	
-	//glTranslatef(0, y_dist, z_dist);
-	glRotatef(planet.rotate_angle, 0., 1., 0.);
-	OsuSphere(planet.radius_scaled, 30, 30);
+	glMultMatrixf(Scene.scene[BodyNode[i]]);
+	glRotatef(Bodies.rotate[i], 0., 1., 0.);	// the texture's spin, which the body's children don't share
+	OsuSphere(Bodies.radiusScaled[i], Bodies.slices[i], Bodies.stacks[i]);
 	glPopMatrix();
 
 }
 
 void
-DrawSun(struct Solar_System_Obj planet)
+DrawSun(int i)
 {
-	planet.radius_scaled = (float)planet.radius / RADIUS_SCALE_FACTOR;
-	planet.distance_scaled = -2 * planet.radius_scaled; // move sun to 1-sun distance behind spaceship starting point
+	float radius_scaled = Bodies.radiusScaled[i];
 
 	// CREATE LIGHT SOURCES - 1 center pt and 4 diameter pt lights will represent sun's size
 	
 	// SUN CENTER and PERIMETER LIGHTS
-	glTranslatef(-50, 0., -1.);
+	float lightPos[3], perimeterPos[3];
+	WorldToScene(SUN_LIGHT_OFFSET_X * DISTANCE_SCALE_FACTOR, 0., SUN_LIGHT_OFFSET_Z * DISTANCE_SCALE_FACTOR, lightPos);
+	WorldToScene(SUN_LIGHT_OFFSET_X * DISTANCE_SCALE_FACTOR + Bodies.x[i], 0., SUN_LIGHT_OFFSET_Z * DISTANCE_SCALE_FACTOR, perimeterPos);
+
+	glPushMatrix();
+	glTranslatef(lightPos[0], lightPos[1], lightPos[2]);
 	SetSunLight(GL_LIGHT0, 0., 0., 0., 1., 1., 1.);
+	glPopMatrix();
 
 	glDisable(GL_LIGHTING);
 	glColor3f(1., 0., 0.);
-	glTranslatef(planet.distance_scaled, 0., 0.);
+	glPushMatrix();
+	glTranslatef(perimeterPos[0], perimeterPos[1], perimeterPos[2]);
 	
 	glPushMatrix();
-	glTranslatef(0, 0., -planet.radius_scaled);
-	SetSunLight(GL_LIGHT2, 0., 0., -planet.radius_scaled, 1., 1., 1.);
+	glTranslatef(0, 0., -radius_scaled);
+	SetSunLight(GL_LIGHT2, 0., 0., -radius_scaled, 1., 1., 1.);
 	glPopMatrix();
 
 	glPushMatrix();
-	glTranslatef(0, 0., planet.radius_scaled);
-	SetSunLight(GL_LIGHT3, 0., 0., planet.radius_scaled, 1., 1., 1.);
+	glTranslatef(0, 0., radius_scaled);
+	SetSunLight(GL_LIGHT3, 0., 0., radius_scaled, 1., 1., 1.);
 	glPopMatrix();
 
 	glPushMatrix();
-	glTranslatef(0, -planet.radius_scaled, 0.);
-	SetSunLight(GL_LIGHT4, 0., -planet.radius_scaled, 0., 1., 1., 1.);
+	glTranslatef(0, -radius_scaled, 0.);
+	SetSunLight(GL_LIGHT4, 0., -radius_scaled, 0., 1., 1., 1.);
 	glPopMatrix();
 
 	glPushMatrix();
-	glTranslatef(0, planet.radius_scaled, 0.);
-	SetSunLight(GL_LIGHT5, 0., planet.radius_scaled, 0., 1., 1., 1.);
+	glTranslatef(0, radius_scaled, 0.);
+	SetSunLight(GL_LIGHT5, 0., radius_scaled, 0., 1., 1., 1.);
 	glPopMatrix();
 
 	glPopMatrix();
 
 	// CREATE TEXTURED SUN
-	glBindTexture(GL_TEXTURE_2D, planet.texture_name);
+	glBindTexture(GL_TEXTURE_2D, Bodies.texture[i]);
 	glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
 
-	glPushMatrix();
-	glTranslatef(planet.distance_scaled, 0., 0.);
+	if (BodyVisible(i)) {		// the lights above are needed even when the sun itself is off screen
+		glPushMatrix();
+		glMultMatrixf(Scene.scene[BodyNode[i]]);
 
-	OsuSphere(planet.radius_scaled, 30, 30);
-	glPopMatrix();
+		OsuSphere(Bodies.radiusScaled[i], Bodies.slices[i], Bodies.stacks[i]);
+		glPopMatrix();
+	}
 	glEnable(GL_LIGHTING);
 
 }
@@ -1822,26 +2217,22 @@ DrawStars(int num)
 	glPointSize(1.);
 	glEnable(GL_POINT_SMOOTH);
 	glDisable(GL_LIGHTING);
-	glPushMatrix();
-		
-		glBegin(GL_POINTS);
-			
-			for (int i = 0; i < NUM_STARS; i++) {
-				if (StarLocations[i][0] >= 0) {
-					glColor3f(BlueShift[0], BlueShift[1], BlueShift[2]);
-				}
-				else {
-					glColor3f(RedShift[0], RedShift[1], RedShift[2]);
-				}
-
-				glVertex3f(StarLocations[i][0], StarLocations[i][1], StarLocations[i][2]);
-
-			}
-			//glVertex3f(100., 100., 1.);
-			//glVertex3f(300., 70., 1.);
-		glEnd();
+	glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glVertexPointer(3, GL_FLOAT, 0, StarChunkVerts);
+
+	// each chunk lies wholly on one side of x = 0, so it is all red- or all blue-shifted:
+	for (int v = 0; v < NumVisibleChunks; v++) {
+		int c = VisibleChunks[v];
+		int count = StarChunkFirst[c + 1] - StarChunkFirst[c];
+		if (SkyBvh.center[c][0] >= 0.)
+			glColor3fv(SimFrame->blueShift);
+		else
+			glColor3fv(SimFrame->redShift);
+		glDrawArrays(GL_POINTS, StarChunkFirst[c], count);
+	}
+	glPopClientAttrib();
 
-	glPopMatrix();
 	glEnable(GL_LIGHTING);
 	glDisable(GL_POINT_SMOOTH);
 
@@ -1849,139 +2240,137 @@ DrawStars(int num)
 }
 
 void
-ChangeLightShift(int change)
+ChangeLightShift(struct SimContext *sim, int change)
 {
 	if (change == 0) {
 		// speed is low, lower relativistic shift
-		RedShift[1] += .1;
-		RedShift[2] += .1;
-		BlueShift[0] += .1;
-		BlueShift[1] += .1;
+		sim->redShift[1] += .1;
+		sim->redShift[2] += .1;
+		sim->blueShift[0] += .1;
+		sim->blueShift[1] += .1;
 	}
 	else {
 		// speed is high, higher relativistic shift
-		RedShift[1] -= .1;
-		RedShift[2] -= .1;
-		BlueShift[0] -= .1;
-		BlueShift[1] -= .1;
+		sim->redShift[1] -= .1;
+		sim->redShift[2] -= .1;
+		sim->blueShift[0] -= .1;
+		sim->blueShift[1] -= .1;
 	}
 }
 
 void
-GoLightSpeed(void)
+GoLightSpeed(struct SimContext *sim)
 // special speed triggered by keyboard that shows how relatively slow light is, given the distances involved
 {
-	if (ForwardDirection == false) {
-		ForwardDirection = true;
-		FlipSpaceship = true; // flip spacecraft around
+	if (sim->forward == false) {
+		sim->forward = true;
+		sim->flip = true; // flip spacecraft around
 	}
 
 
 
 #define max_to_c_ratio 134
-	//velocity = .005;
-	velocity = .05 / 134;
-	LightSpeedMultiple = 1;
-	EngineDiffuse = .2;
+	//sim->velocity = .005;
+	sim->velocity = .05 / 134;
+	sim->lightSpeedMultiple = 1;
+	sim->engineDiffuse = .2;
 	
 	// blue and red shift
-	RedShift[1] = .5;
-	RedShift[2] = .5;
-	BlueShift[0] = .5;
-	BlueShift[1] = .5;
+	sim->redShift[1] = .5;
+	sim->redShift[2] = .5;
+	sim->blueShift[0] = .5;
+	sim->blueShift[1] = .5;
 
 
 }
 
 void
-DecreaseVelocity(void)
+DecreaseVelocity(struct SimContext *sim)
 {
 
-	if (ForwardDirection) {
-		ForwardDirection = false;
-		FlipSpaceship = true; // flip spacecraft around
+	if (sim->forward) {
+		sim->forward = false;
+		sim->flip = true; // flip spacecraft around
 	}
 
 
-	EngineAmbient = 0.;
-	if (velocity > SPEED_MIN) {
-		ChangeLightShift(0);
-		velocity -= SPEED_DECR_STEP;
-		velocity = max(SPEED_MIN, velocity);
+	sim->engineAmbient = 0.;
+	if (sim->velocity > SPEED_MIN) {
+		ChangeLightShift(sim, 0);
+		sim->velocity -= SPEED_DECR_STEP;
+		sim->velocity = max(SPEED_MIN, sim->velocity);
 		// lower engine lighting
-		EngineDiffuse *= .8;
-		EngineSpecular -= .05;
-		LightSpeedMultiple = getLightSpeedMultiple(115); // get speed of spaceship as multiple of lightspeed
-		setVelocityText();
+		sim->engineDiffuse *= .8;
+		sim->engineSpecular -= .05;
+		sim->lightSpeedMultiple = getLightSpeedMultiple(sim, 115); // get speed of spaceship as multiple of lightspeed
 	}
-	if (velocity <= SPEED_MIN) {
-		EngineDiffuse = 0.;
-		EngineSpecular = 0.;
+	if (sim->velocity <= SPEED_MIN) {
+		sim->engineDiffuse = 0.;
+		sim->engineSpecular = 0.;
 	}
 }
 
 void
-IncreaseVelocity(void)
+IncreaseVelocity(struct SimContext *sim)
 {
-	if (ForwardDirection == false) {
-		ForwardDirection = true;
-		FlipSpaceship = true; // flip spacecraft around
+	if (sim->forward == false) {
+		sim->forward = true;
+		sim->flip = true; // flip spacecraft around
 	}
 	
-	if (velocity < SPEED_MAX) {
-		ChangeLightShift(1);
-		velocity += SPEED_INCR_STEP;
-		velocity = min(SPEED_MAX, velocity);
+	if (sim->velocity < SPEED_MAX) {
+		ChangeLightShift(sim, 1);
+		sim->velocity += SPEED_INCR_STEP;
+		sim->velocity = min(SPEED_MAX, sim->velocity);
 		//higher engine lighting
-		EngineDiffuse += .1;
-		EngineSpecular += .05;
-		//printf("vel: %f\n", velocity);
-		LightSpeedMultiple = getLightSpeedMultiple(115); // get speed of spaceship as multiple of lightspeed
-		setVelocityText();
+		sim->engineDiffuse += .1;
+		sim->engineSpecular += .05;
+		//printf("vel: %f\n", sim->velocity);
+		sim->lightSpeedMultiple = getLightSpeedMultiple(sim, 115); // get speed of spaceship as multiple of lightspeed
 	}
 	else {
-		EngineAmbient = .2;
+		sim->engineAmbient = .2;
 	}
 		
 }
 
-float*
-MulArray3(float factor, float array0[3])
+struct Vec4
+MulArray3(float factor, const float array0[3])
 {
-	static float array[4];
+	struct Vec4 array;
 
-	array[0] = factor * array0[0];
-	array[1] = factor * array0[1];
-	array[2] = factor * array0[2];
-	array[3] = 1.;
+	array.v[0] = factor * array0[0];
+	array.v[1] = factor * array0[1];
+	array.v[2] = factor * array0[2];
+	array.v[3] = 1.;
 	return array;
 }
 
-float*
+struct Vec4
 Array3(float a, float b, float c)
 {
-	static float array[4];
+	struct Vec4 array;
 
-	array[0] = a;
-	array[1] = b;
-	array[2] = c;
-	array[3] = 1.;
+	array.v[0] = a;
+	array.v[1] = b;
+	array.v[2] = c;
+	array.v[3] = 1.;
 	return array;
 }
 
 void
 SetMaterial(float r, float g, float b, float shininess)
 {
-	glMaterialfv(GL_BACK, GL_EMISSION, Array3(0., 0., 0.));
-	glMaterialfv(GL_BACK, GL_AMBIENT, MulArray3(.4f, White));
-	glMaterialfv(GL_BACK, GL_DIFFUSE, MulArray3(1., White));
-	glMaterialfv(GL_BACK, GL_SPECULAR, Array3(0., 0., 0.));
+	glMaterialfv(GL_BACK, GL_EMISSION, Array3(0., 0., 0.).v);
+	glMaterialfv(GL_BACK, GL_AMBIENT, MulArray3(.4f, White).v);
+	glMaterialfv(GL_BACK, GL_DIFFUSE, MulArray3(1., White).v);
+	glMaterialfv(GL_BACK, GL_SPECULAR, Array3(0., 0., 0.).v);
 	glMaterialf(GL_BACK, GL_SHININESS, 5.f);
 
-	glMaterialfv(GL_FRONT, GL_EMISSION, Array3(0., 0., 0.));
-	glMaterialfv(GL_FRONT, GL_AMBIENT, Array3(r, g, b));
-	glMaterialfv(GL_FRONT, GL_DIFFUSE, Array3(r, g, b));
-	glMaterialfv(GL_FRONT, GL_SPECULAR, MulArray3(.8f, White));
+	glMaterialfv(GL_FRONT, GL_EMISSION, Array3(0., 0., 0.).v);
+	glMaterialfv(GL_FRONT, GL_AMBIENT, Array3(r, g, b).v);
+	glMaterialfv(GL_FRONT, GL_DIFFUSE, Array3(r, g, b).v);
+	glMaterialfv(GL_FRONT, GL_SPECULAR, MulArray3(.8f, White).v);
 	glMaterialf(GL_FRONT, GL_SHININESS, shininess);
 }
 
@@ -1991,10 +2380,10 @@ SetSunLight(int ilight, float x, float y, float z, float r, float g, float b)
 {
 	GLfloat sun_ambient[] = { 0.1, 0.1, 0.1, 1.0 };
 	GLfloat sun_specular[] = { 0.2, 0.2, 0.2, 1.0 };
-	glLightfv(ilight, GL_POSITION, Array3(x, y, z));
+	glLightfv(ilight, GL_POSITION, Array3(x, y, z).v);
 	glLightfv(ilight, GL_AMBIENT, sun_ambient);
 	//glLightfv(ilight, GL_DIFFUSE, diffuse);
-	glLightfv(ilight, GL_DIFFUSE, Array3(r, g, b));
+	glLightfv(ilight, GL_DIFFUSE, Array3(r, g, b).v);
 	glLightfv(ilight, GL_SPECULAR, sun_specular);
 	glLightf(ilight, GL_CONSTANT_ATTENUATION, 1.);
 	//glLightf(ilight, GL_LINEAR_ATTENUATION, 0.);  // NO ATTENUATION
@@ -2005,15 +2394,15 @@ SetSunLight(int ilight, float x, float y, float z, float r, float g, float b)
 
 
 float
-getLightSpeedMultiple(int seconds)
-// enter seconds elapsed from journey beginning to Neptune at velocity set at .05
+getLightSpeedMultiple(struct SimContext *sim, int seconds)
+// enter seconds elapsed from journey beginning to the farthest body at velocity set at .05
 // Returns speed as a multiple of c
 {
 	int mps_c = 186282; // light speed in miles-per-second
 	float baseline_velocity = .05;
-	float velocity_ratio = velocity / baseline_velocity;
+	float velocity_ratio = sim->velocity / baseline_velocity;
 
-	float baseline_c_multiple = Neptune.solar_distance / seconds / mps_c;
+	float baseline_c_multiple = sim->tourLength / seconds / mps_c;
 	
 	//printf("baseline speed multiple %f\n", baseline_c_multiple);
 	//printf("current speed multiple %f\n", baseline_c_multiple * velocity_ratio);
@@ -2021,22 +2410,46 @@ getLightSpeedMultiple(int seconds)
 
 }
 
+// draw the velocity readout -- the text and its glyph quads are only rebuilt when
+// LightSpeedMultiple changes:
+
 void
-setVelocityText(void)
+setVelocityText(int viewport)
 {
-	char MsgText[256];
-	char VelocityString[16];
-	sprintf(VelocityString, "%f", round(LightSpeedMultiple));
-	//printf("text should show %f\n", LightSpeedMultiple);
-	strcpy(MsgText, "Velocity (lightspeed multiple): ");
-	strcat(MsgText, VelocityString);
-	DoRasterString(5.f, 5.f, 0.f, MsgText);
+	static float shownMultiple = -1.;
+	static char MsgText[256];
+
+	if (SimFrame->lightSpeedMultiple != shownMultiple || MsgText[0] == '\0') {
+		shownMultiple = SimFrame->lightSpeedMultiple;
+		sprintf(MsgText, "Velocity (lightspeed multiple): %f", round(shownMultiple));
+	}
+
+	if (GlyphAtlasReady) {
+		HudSetText(&VelocityHud, 5.f, 5.f, viewport, MsgText);
+		HudDrawString(&VelocityHud);
+	}
+	else {
+		DoRasterString(5.f, 5.f, 0.f, MsgText);
+	}
 }
 
+// (re)make the stars, num of them -- the same ones each time for the same num:
+
 void
 getRandomStarLocations(int num) {
 	int x, y, z;
-	
+
+	if (StarLocations != NULL) {
+		MemSub(MEM_STARS, (long long)NumStars * (sizeof(StarLocations[0]) + sizeof(StarChunkVerts[0])));
+		delete [] StarLocations;
+		delete [] StarChunkVerts;
+	}
+	NumStars = num;
+	StarLocations = new int[num][3];
+	StarChunkVerts = new float[num][3];
+	MemAdd(MEM_STARS, (long long)num * (sizeof(StarLocations[0]) + sizeof(StarChunkVerts[0])));
+
+	srand(1);
 	for (int i = 0; i < num; i++) {
 		
 		x = rand() % 2000 - 1000; // rand between -500 and 500 (-500 is the offset)
@@ -2048,4 +2461,1255 @@ getRandomStarLocations(int num) {
 		StarLocations[i][2] = z;
 	}
 
-}
\ No newline at end of file
+	BuildStarChunks();
+}
+
+// sort the stars into chunks (a counting sort), so each chunk can be culled as one sphere,
+// and put the chunks' spheres into SkyBvh:
+
+void
+BuildStarChunks(void)
+{
+	int *chunkOf = new int[NumStars];
+	int count[NUM_STAR_CHUNKS] = { 0 };
+	float chunkSize = 2.f * STAR_CUBE_HALF / STAR_CHUNKS_PER_AXIS;
+	for (int i = 0; i < NumStars; i++) {
+		int c[3];
+		for (int k = 0; k < 3; k++) {
+			c[k] = (int)((StarLocations[i][k] + STAR_CUBE_HALF) / chunkSize);
+			if (c[k] < 0)
+				c[k] = 0;
+			if (c[k] >= STAR_CHUNKS_PER_AXIS)
+				c[k] = STAR_CHUNKS_PER_AXIS - 1;
+		}
+		chunkOf[i] = c[0] + STAR_CHUNKS_PER_AXIS * (c[1] + STAR_CHUNKS_PER_AXIS * c[2]);
+		count[chunkOf[i]]++;
+	}
+
+	StarChunkFirst[0] = 0;
+	for (int c = 0; c < NUM_STAR_CHUNKS; c++)
+		StarChunkFirst[c + 1] = StarChunkFirst[c] + count[c];
+
+	int next[NUM_STAR_CHUNKS];
+	for (int c = 0; c < NUM_STAR_CHUNKS; c++)
+		next[c] = StarChunkFirst[c];
+	for (int i = 0; i < NumStars; i++) {
+		int j = next[chunkOf[i]]++;
+		StarChunkVerts[j][0] = (float)StarLocations[i][0];
+		StarChunkVerts[j][1] = (float)StarLocations[i][1];
+		StarChunkVerts[j][2] = (float)StarLocations[i][2];
+	}
+	delete [] chunkOf;
+
+	// empty chunks go in too, so an object number is always a chunk number:
+	double center[NUM_STAR_CHUNKS][3], radius[NUM_STAR_CHUNKS];
+	for (int c = 0; c < NUM_STAR_CHUNKS; c++) {
+		center[c][0] = -STAR_CUBE_HALF + (c % STAR_CHUNKS_PER_AXIS + .5) * chunkSize;
+		center[c][1] = -STAR_CUBE_HALF + ((c / STAR_CHUNKS_PER_AXIS) % STAR_CHUNKS_PER_AXIS + .5) * chunkSize;
+		center[c][2] = -STAR_CUBE_HALF + (c / (STAR_CHUNKS_PER_AXIS * STAR_CHUNKS_PER_AXIS) + .5) * chunkSize;
+		radius[c] = .5 * sqrt(3.) * chunkSize;
+	}
+	BvhBuild(&SkyBvh, NUM_STAR_CHUNKS, center, radius);
+}
+// queue a user request so the simulation thread applies it on its next tick, not mid-frame:
+
+void
+PostSimCommand(int command)
+{
+	if (CommandQueuePush(&Sim.input, command))
+		LatencyInput();
+	else
+		fprintf(stderr, "Simulation command queue full, dropping command %d\n", command);
+}
+
+// set up a tour's context, at the start, at rest, with nothing queued:
+
+void
+SimInit(struct SimContext *sim)
+{
+	CommandQueueInit(&sim->input);
+	sim->inputsApplied = 0;
+	sim->tourLength = TourLength;
+	SimReset(sim);
+}
+
+// put a tour back at the start, at rest:
+
+void
+SimReset(struct SimContext *sim)
+{
+	sim->travel = sim->prevTravel = 0.;
+	sim->simTimeMS = 0.;
+	sim->velocity = 0;
+	sim->lightSpeedMultiple = 0.;
+	sim->engineAmbient = sim->engineDiffuse = sim->engineSpecular = 0.;
+	sim->forward = true;
+	sim->flip = false;
+	for (int k = 0; k < 3; k++)
+		sim->redShift[k] = sim->blueShift[k] = 1.;
+}
+
+// advance a tour by exactly one SIM_TICK_MS step:
+
+void
+SimStep(struct SimContext *sim)
+{
+	int command;
+	while (CommandQueuePop(&sim->input, &command)) {
+		sim->appliedAt[sim->inputsApplied % LATENCY_APPLIED] = std::chrono::steady_clock::now();
+		sim->inputsApplied++;
+		switch (command) {
+			case SIM_FASTER:
+				IncreaseVelocity(sim);
+				break;
+
+			case SIM_SLOWER:
+				DecreaseVelocity(sim);
+				break;
+
+			case SIM_LIGHTSPEED:
+				GoLightSpeed(sim);
+				break;
+
+			case SIM_RESET:
+				SimReset(sim);
+				break;
+		}
+	}
+
+	sim->prevTravel = sim->travel;
+	sim->travel += sim->velocity * DISTANCE_SCALE_FACTOR * SIM_TICK_MS;
+	sim->simTimeMS += SIM_TICK_MS;
+}
+
+// copy the interactive tour's state into the triple buffer for the render thread:
+
+void
+SimPublish(void)
+{
+	struct SimSnapshot *snap = TripleBufferBack(&SimSnapshots);
+	snap->travel = Sim.travel;
+	snap->prevTravel = Sim.prevTravel;
+	snap->simTimeMS = Sim.simTimeMS;
+	snap->velocity = Sim.velocity;
+	snap->lightSpeedMultiple = Sim.lightSpeedMultiple;
+	snap->engineAmbient = Sim.engineAmbient;
+	snap->engineDiffuse = Sim.engineDiffuse;
+	snap->engineSpecular = Sim.engineSpecular;
+	memcpy(snap->redShift, Sim.redShift, sizeof(snap->redShift));
+	memcpy(snap->blueShift, Sim.blueShift, sizeof(snap->blueShift));
+	snap->forward = Sim.forward;
+	snap->flip = Sim.flip;
+	snap->moving = Sim.velocity != 0. || Sim.travel != Sim.prevTravel;
+	snap->inputsApplied = Sim.inputsApplied;
+	memcpy(snap->appliedAt, Sim.appliedAt, sizeof(snap->appliedAt));
+	snap->published = std::chrono::steady_clock::now();
+	TripleBufferPublish(&SimSnapshots);
+}
+
+// the simulation thread: tick on a fixed schedule until told to quit
+// while the ship is at rest and no input is waiting, ticks are skipped, so -- as before --
+// time spent at rest doesn't advance the planets
+
+void
+SimThreadMain(void)
+{
+	TRACE_THREAD_NAME("simulation");
+	std::chrono::duration<double, std::milli> tick(SIM_TICK_MS);
+	std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now();
+	bool moving = false;
+	while (!SimQuit) {
+		next += std::chrono::duration_cast<std::chrono::steady_clock::duration>(tick);
+		std::this_thread::sleep_until(next);
+
+		// clamp a stall (a debugger, a suspended laptop) so we don't spiral trying to catch up:
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		if (now - next > std::chrono::duration<double, std::milli>(SIM_MAX_FRAME_MS))
+			next = now;
+
+		if (!moving && CommandQueueEmpty(&Sim.input))
+			continue;
+		TRACE_BEGIN(tickZone, "simulation tick");
+		SimStep(&Sim);
+		SimPublish();
+		TRACE_END(tickZone);
+		moving = Sim.velocity != 0. || Sim.travel != Sim.prevTravel;
+	}
+}
+
+// headless parameter sweep over velocity profiles:
+// tour t presses SIM_FASTER every rampTicks ticks until it has pressed cruiseLevel times, then
+// cruises past the farthest body, moons included; each tour has its own SimContext, so they all
+// run at once
+// the cruise levels cycle through every speed step, and the ramps spread evenly from a press
+// every tick to one every SWEEP_RAMP_TICKS, so no two of the first SWEEP_RAMP_TICKS tours ramp alike
+
+struct SweepTour
+{
+	int		cruiseLevel;			// SIM_FASTER presses, 1 to SPEED_MAX / SPEED_INCR_STEP
+	int		rampTicks;				// ticks between presses
+	int		ticks;					// ticks it took
+	float	maxMultiple;			// top speed, as a multiple of c
+	double	*passedMS;				// simulated time at which it passed each body, -1 if never
+	double	end;					// route distance to fly, miles: the farthest body's
+};
+
+void
+RunSweepTours(void *data, int first, int last)
+{
+	struct SweepTour *tours = (struct SweepTour *)data;
+	for (int t = first; t < last; t++) {
+		struct SweepTour *tour = &tours[t];
+		struct SimContext sim;
+		SimInit(&sim);
+
+		int presses = 0;
+		for (int b = 0; b < Bodies.n; b++)
+			tour->passedMS[b] = -1.;
+		for (tour->ticks = 0; sim.travel < tour->end && tour->ticks < SWEEP_MAX_TICKS; tour->ticks++) {
+			if (presses < tour->cruiseLevel && tour->ticks % tour->rampTicks == 0) {
+				CommandQueuePush(&sim.input, SIM_FASTER);
+				presses++;
+			}
+			SimStep(&sim);
+			for (int b = 0; b < Bodies.n; b++) {
+				if (tour->passedMS[b] < 0. && sim.travel >= Bodies.x[b])
+					tour->passedMS[b] = sim.simTimeMS;
+			}
+			if (sim.lightSpeedMultiple > tour->maxMultiple)
+				tour->maxMultiple = sim.lightSpeedMultiple;
+		}
+	}
+}
+
+// run n tours on every core and print the results as JSON:
+
+void
+RunSweep(int n, FILE *fp)
+{
+	// with -date, the tours fly past the planets where they were that day:
+	struct SimSnapshot start;
+	start.simTimeMS = 0.;
+	SimFrame = &start;
+	UpdatePlanetPositions();
+	SimFrame = NULL;
+
+	// tourLength only reaches the root's children, so fly on past any moons beyond them:
+	double end = TourLength;
+	for (int b = 0; b < Bodies.n; b++)
+		if (Bodies.x[b] > end)
+			end = Bodies.x[b];
+
+	int levels = (int)(SPEED_MAX / SPEED_INCR_STEP + .5);
+	struct SweepTour *tours = new struct SweepTour[n];
+	for (int t = 0; t < n; t++) {
+		tours[t].end = end;
+		tours[t].cruiseLevel = 1 + t % levels;
+		tours[t].rampTicks = 1 + t * SWEEP_RAMP_TICKS / n;
+		tours[t].maxMultiple = 0.;
+		tours[t].passedMS = new double[Bodies.n];
+	}
+
+	struct JobSystem js;
+	JobsStart(&js, JobThreads);
+	std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+	ParallelFor(&js, n, 1, RunSweepTours, tours);
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+	JobsStop(&js);
+
+	fprintf(fp, "{\n  \"tours\": %d,\n  \"threads\": %d,\n  \"wall_ms\": %.1f,\n  \"results\": [\n", n, js.numThreads, ms);
+	for (int t = 0; t < n; t++) {
+		struct SweepTour *tour = &tours[t];
+		fprintf(fp, "    { \"cruise_level\": %d, \"ramp_ticks\": %d, \"ticks\": %d, \"max_c\": %.2f, \"seconds_to\": {",
+			tour->cruiseLevel, tour->rampTicks, tour->ticks, tour->maxMultiple);
+		for (int b = 0; b < Bodies.n; b++) {
+			if (tour->passedMS[b] < 0.)		// never got there in SWEEP_MAX_TICKS
+				fprintf(fp, "%s \"%s\": null", b == 0 ? "" : ",", Bodies.name[b]);
+			else
+				fprintf(fp, "%s \"%s\": %.3f", b == 0 ? "" : ",", Bodies.name[b], tour->passedMS[b] / 1000.);
+		}
+		fprintf(fp, " } }%s\n", t == n - 1 ? "" : ",");
+		delete [] tour->passedMS;
+	}
+	fprintf(fp, "  ],\n");
+	MemReportJson(fp, "  ");
+	fprintf(fp, "\n}\n");
+	delete [] tours;
+}
+
+// run the scripted scenarios on the main thread, in place of the simulation thread: each frame
+// first does what the script says for it, then steps the simulation by exactly 1000 / TargetFPS
+// ms, so a script draws the same frames every time
+// the whole frame is timed through glFinish( ), and its phases with the tracer's zones
+// with -golden, every frame is drawn offscreen at -size, and the ones a scenario captures are
+// checked against the golden images after they are timed
+// prints the results as JSON, and returns false if any scenario regressed against -baseline or
+// any image differed
+
+static void
+ScenarioApply(const struct Scenario *s, int frame)
+{
+	static const int commands[] = { SIM_FASTER, SIM_SLOWER, SIM_LIGHTSPEED, SIM_RESET };
+	for (unsigned int k = 0; k < s->events.size(); k++) {
+		const struct ScenarioEvent *e = &s->events[k];
+		if (frame < e->first || frame > e->last)
+			continue;
+		double t = e->last > e->first ? (double)(frame - e->first) / (e->last - e->first) : 0.;
+		double value = e->from + (e->to - e->from) * t;
+		switch (e->action) {
+			case SCN_FASTER:
+			case SCN_SLOWER:
+			case SCN_LIGHTSPEED:
+			case SCN_RESET:
+				for (int c = 0; c < e->count; c++)
+					CommandQueuePush(&Sim.input, commands[e->action]);
+				break;
+
+			case SCN_PLACE:
+				Sim.travel = Sim.prevTravel = Bodies.x[e->body] + value * DistanceScale;
+				break;
+
+			case SCN_XROT:
+				Xrot = (float)value;
+				break;
+
+			case SCN_YROT:
+				Yrot = (float)value;
+				break;
+
+			case SCN_SCALE:
+				Scale = (float)value;
+				break;
+		}
+	}
+}
+
+// put everything back at the start for scenario s:
+
+static void
+ScenarioStart(const struct Scenario *s, int defaultStars)
+{
+	int stars = s->stars > 0 ? s->stars : defaultStars;
+	if (stars != NumStars)
+		getRandomStarLocations(stars);
+	Reset();
+	SimStep(&Sim);			// apply the reset before anything else
+	SimReset(&Sim);
+}
+
+// do what the script says for frame f, then step the simulation to it:
+
+static void
+ScenarioStep(const struct Scenario *s, int frame)
+{
+	ScenarioApply(s, frame);
+	double until = Sim.simTimeMS + 1000. / TargetFPS;
+	while (Sim.simTimeMS < until - .001)
+		SimStep(&Sim);
+	SimPublish();
+}
+
+bool
+RunScenarios(FILE *fp)
+{
+	FixedStep = true;
+	bool ownTrace = !TraceOn;
+	if (ownTrace)
+		TraceStart(NULL);
+	int defaultStars = NumStars;
+	bool passed = true;
+	bool traceFull = false;			// -trace's buffer filled, so some phase times are missing
+
+	unsigned char *capture = NULL;
+	if (GoldenDir != NULL) {
+		if (!OffscreenInit(&FrameTarget, OffscreenWidth, OffscreenHeight))
+			return false;
+		RenderTarget = &FrameTarget;
+		capture = new unsigned char[3 * OffscreenWidth * OffscreenHeight];
+	}
+
+	std::vector<struct ScenarioResult> results(Scenarios.size());
+	for (unsigned int k = 0; k < Scenarios.size(); k++) {
+		const struct Scenario *s = &Scenarios[k];
+		struct ScenarioResult *r = &results[k];
+		strcpy(r->name, s->name);
+		r->frames = 0;
+		r->hasBaseline = r->regressed = false;
+		fprintf(stderr, "Scenario '%s': %d frames\n", s->name, s->frames);
+		ScenarioStart(s, defaultStars);
+		ScenarioGetPhase(r, "frame", 0);
+
+		for (int f = 0; f < s->frames; f++) {
+			ScenarioStep(s, f);
+
+			int first;
+			TraceThreadEvents(&first);
+			std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+			Animate();
+			Display();
+			glFinish();
+			double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+			if (f >= s->warmup) {
+				ScenarioBeginFrame(r);
+				ScenarioAddTime(r, "frame", ms);
+				int count;
+				const struct TraceEvent *events = TraceThreadEvents(&count);
+				for (int i = first; i < count; i++)
+					ScenarioAddTime(r, events[i].name, (events[i].end - events[i].start) / 1.e6);
+			}
+			if (ownTrace)
+				TraceThreadRewind();
+			else if (!traceFull && TraceThreadDropped() > 0) {
+				fprintf(stderr, "Scenario '%s': the -trace buffer filled up at frame %d, so the phase times from here on are "
+					"incomplete and won't be compared or saved -- run the scenarios without -trace to time them\n", s->name, f);
+				traceFull = true;
+				passed = false;
+			}
+
+			if (capture != NULL && std::find(s->captures.begin(), s->captures.end(), f) != s->captures.end()) {
+				OffscreenRead(&FrameTarget, capture);
+				if (!GoldenCheck(s->name, f, capture, OffscreenWidth, OffscreenHeight))
+					passed = false;
+			}
+		}
+		ScenarioFinish(r);
+	}
+	if (NumStars != defaultStars)
+		getRandomStarLocations(defaultStars);
+	if (ownTrace)
+		TraceWrite();
+	FixedStep = false;
+	if (capture != NULL) {
+		delete [] capture;
+		RenderTarget = NULL;
+		OffscreenFree(&FrameTarget);
+	}
+
+	if (!traceFull && ScenarioBaseline != NULL && ReadScenarioBaseline(ScenarioBaseline, &results)) {
+		for (unsigned int k = 0; k < results.size(); k++) {
+			if (!results[k].hasBaseline)
+				fprintf(stderr, "Scenario '%s' isn't in the baseline\n", results[k].name);
+			else if (ScenarioCompare(&results[k], Scenarios[k].tolerance, stderr))
+				passed = false;
+		}
+	}
+	if (ScenarioSaveBaseline != NULL && !traceFull)
+		WriteScenarioBaseline(ScenarioSaveBaseline, results);
+
+	fprintf(fp, "{\n  \"fps\": %d,\n  \"passed\": %s,\n", TargetFPS, passed ? "true" : "false");
+	ScenarioReportJson(fp, "  ", results);
+	fprintf(fp, ",\n");
+	if (GoldenDir != NULL) {
+		GoldenReportJson(fp, "  ");
+		fprintf(fp, ",\n");
+	}
+	MemReportJson(fp, "  ");
+	fprintf(fp, "\n}\n");
+	return passed;
+}
+
+// render the scenarios' frames offscreen at -size, back to back, into -video's file, for
+// exactly -fps frames a second of the tour -- as fast as they can be drawn, not in real time:
+// returns false if the video couldn't be written
+
+bool
+RunVideo(void)
+{
+	if (!OffscreenInit(&FrameTarget, OffscreenWidth, OffscreenHeight) ||
+		!VideoOpen(VideoFile, OffscreenWidth, OffscreenHeight, TargetFPS, JobThreads))
+		return false;
+	RenderTarget = &FrameTarget;
+	FixedStep = true;
+	int defaultStars = NumStars;
+
+	std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+	for (unsigned int k = 0; k < Scenarios.size(); k++) {
+		const struct Scenario *s = &Scenarios[k];
+		fprintf(stderr, "Rendering scenario '%s': %d frames\n", s->name, s->frames);
+		ScenarioStart(s, defaultStars);
+		for (int f = 0; f < s->frames; f++) {
+			ScenarioStep(s, f);
+			Animate();
+			Display();
+			VideoCapture(&FrameTarget);
+		}
+	}
+	bool ok = VideoClose();
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+	fprintf(stderr, "Wrote %lld frames of %d x %d to '%s' in %.1f s, %.1f frames/s\n", Video.framesWritten,
+		OffscreenWidth, OffscreenHeight, VideoFile, seconds, Video.framesWritten / (seconds > 0. ? seconds : 1.));
+	fprintf(stderr, "(waited %.0f ms on the gpu for readbacks, %.0f ms on the writer)\n", Video.mapWaitMS, Video.stallMS);
+
+	if (NumStars != defaultStars)
+		getRandomStarLocations(defaultStars);
+	FixedStep = false;
+	RenderTarget = NULL;
+	OffscreenFree(&FrameTarget);
+	return ok;
+}
+
+// glut calls this once the window is up when -scenarios was given; the exit status says
+// whether they all passed (or with -video, whether it was written):
+
+void
+ScenarioTimer(int /*value*/)
+{
+	glutSetWindow(MainWindow);
+	bool passed = VideoFile != NULL ? RunVideo() : RunScenarios(stdout);
+	StopThreads();
+	TraceWrite();
+	exit(passed ? 0 : 1);
+}
+
+// stop the simulation thread and the job system's workers, before exit( ):
+
+void
+StopThreads(void)
+{
+	if (SimThread.joinable()) {
+		SimQuit = true;
+		SimThread.join();
+	}
+	MetricsStop();
+	FrameArenasFree();
+	JobsStop(&Jobs);
+}
+
+// true while the scene changes on its own, so frames must keep coming:
+
+bool
+NeedsAnimation(void)
+{
+	return SimFrame->moving || !CommandQueueEmpty(&Sim.input);
+}
+
+// paced frame callback -- re-arms itself only while there is something to animate:
+
+void
+FrameTimer(int /*value*/)
+{
+	FrameTimerArmed = false;
+	if (!WindowVisible)
+		return;
+
+	Animate();
+
+	if (NeedsAnimation()) {
+		int ms = glutGet(GLUT_ELAPSED_TIME);
+		NextFrameMS += 1000 / TargetFPS;
+		if (NextFrameMS < ms)
+			NextFrameMS = ms;		// fell behind, don't try to catch up
+		FrameTimerArmed = true;
+		glutTimerFunc(NextFrameMS - ms, FrameTimer, 0);
+	}
+}
+
+// poll the latency tracker's fences until the gpu has finished every frame it is waiting on:
+
+void
+LatencyTimer(int /*value*/)
+{
+	glutSetWindow(MainWindow);
+	LatencyTimerArmed = LatencyPoll();
+	if (LatencyTimerArmed)
+		glutTimerFunc(1, LatencyTimer, 0);
+}
+
+// restart the frame timer after input, a menu pick, or the window reappearing:
+// the time spent asleep or hidden is not simulated
+
+void
+WakeAnimation(void)
+{
+	if (FrameTimerArmed || !WindowVisible)
+		return;
+
+	NextFrameMS = glutGet(GLUT_ELAPSED_TIME);
+	FrameTimerArmed = true;
+	glutTimerFunc(0, FrameTimer, 0);
+}
+
+// draw into where the frame ends up: RenderTarget if there is one, else the window's back buffer
+
+void
+BindFrameTarget(void)
+{
+	if (RenderTarget != NULL) {
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, RenderTarget->fbo);
+		glDrawBuffer(GL_COLOR_ATTACHMENT0);
+	}
+	else {
+		if (GLEW_ARB_framebuffer_object)
+			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+		glDrawBuffer(GL_BACK);
+	}
+}
+
+// and its size:
+
+int
+FrameWidth(void)
+{
+	return RenderTarget != NULL ? RenderTarget->width : glutGet(GLUT_WINDOW_WIDTH);
+}
+
+int
+FrameHeight(void)
+{
+	return RenderTarget != NULL ? RenderTarget->height : glutGet(GLUT_WINDOW_HEIGHT);
+}
+
+// bind the reversed-z framebuffer, (re)allocating it at the frame's size, and set its depth state:
+// returns false if the extensions aren't available, in which case nothing is changed
+
+bool
+BeginReversedZ(void)
+{
+	if (!ReversedZSupported)
+		return false;
+
+	int width = FrameWidth();
+	int height = FrameHeight();
+	if (ReversedZFbo == 0) {
+		glGenFramebuffers(1, &ReversedZFbo);
+		glGenRenderbuffers(1, &ReversedZColor);
+		glGenRenderbuffers(1, &ReversedZDepth);
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, ReversedZFbo);
+	if (width != ReversedZWidth || height != ReversedZHeight) {
+		glBindRenderbuffer(GL_RENDERBUFFER, ReversedZColor);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+		glBindRenderbuffer(GL_RENDERBUFFER, ReversedZDepth);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT32F, width, height);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, ReversedZColor);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, ReversedZDepth);
+		ReversedZWidth = width;
+		ReversedZHeight = height;
+
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+			fprintf(stderr, "Reversed-Z framebuffer is incomplete, using the standard depth buffer\n");
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			ReversedZSupported = false;
+			return false;
+		}
+	}
+
+	glClipControl(GL_LOWER_LEFT, GL_ZERO_TO_ONE);
+	glClearDepth(0.);
+	glDepthFunc(GL_GREATER);
+	return true;
+}
+
+// copy the reversed-z frame to the window (or RenderTarget) and put the default depth state back:
+
+void
+EndReversedZ(void)
+{
+	glClipControl(GL_LOWER_LEFT, GL_NEGATIVE_ONE_TO_ONE);
+	glClearDepth(1.);
+	glDepthFunc(GL_LESS);
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, ReversedZFbo);
+	BindFrameTarget();
+	glBlitFramebuffer(0, 0, ReversedZWidth, ReversedZHeight, 0, 0, ReversedZWidth, ReversedZHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+}
+
+// like gluPerspective( ), but with the far plane at infinity and depth running 1. (near) to 0. (infinity):
+// only meaningful with glClipControl( GL_LOWER_LEFT, GL_ZERO_TO_ONE )
+
+void
+LoadInfiniteReversedPerspective(float fovy, float aspect, float znear)
+{
+	float f = 1.f / tanf(fovy * (float)M_PI / 360.f);
+	GLfloat m[16] =
+	{
+		f / aspect,	0.,	0.,		0.,
+		0.,			f,	0.,		0.,
+		0.,			0.,	0.,		-1.,
+		0.,			0.,	znear,	0.
+	};
+	glLoadMatrixf(m);
+}
+
+// when touring from a date, place each planet along the route at its true distance from the sun
+// at that date (plus the simulated time so far):
+// the y/z offsets stay as chosen so the planets are still visible from the route
+
+void
+UpdatePlanetPositions(void)
+{
+	if (TourJulianDate == 0.)
+		return;
+
+	double jd = TourJulianDate + SimFrame->simTimeMS / (1000. * 60. * 60. * 24.);
+	bool evaluated = false;
+	for (int i = 0; i < Bodies.n; i++) {
+		int k = Bodies.ephemerisIndex[i];
+		if (k < 0)
+			continue;
+
+		double xyz[3];
+		if (ChebyshevCovers(&PlanetCache, k, jd)) {
+			ChebyshevPosition(&PlanetCache, k, jd, xyz);
+		}
+		else {
+			// outside the cache (or no cache): solve every orbit once for this frame
+			if (!evaluated) {
+				EphemerisEvaluate(&PlanetEphemeris, jd);
+				evaluated = true;
+			}
+			xyz[0] = PlanetEphemeris.x[k];
+			xyz[1] = PlanetEphemeris.y[k];
+			xyz[2] = PlanetEphemeris.z[k];
+		}
+		Bodies.routeDistance[i] = sqrt(xyz[0] * xyz[0] + xyz[1] * xyz[1] + xyz[2] * xyz[2]) * MILES_PER_AU;
+	}
+	PlaceBodies();
+}
+
+// fill the asteroid belt (2.1-3.3 AU) and the kuiper belt (30-50 AU):
+
+void
+InitBelts(void)
+{
+	if (BeltBodies == 0)
+		return;
+
+	// start the clusters out as wedges on the tour date:
+	double days = TourJulianDate == 0. ? 0. : TourJulianDate - J2000_JD;
+	InitBelt(&AsteroidBelt, BeltBodies, 2.1f, 3.3f, .2f, 15.f, days, .55f, .50f, .45f);
+	InitBelt(&KuiperBelt, BeltBodies, 30.f, 50.f, .15f, 20.f, days, .45f, .50f, .60f);
+	UpdateBelts();
+}
+
+// move the belts along their orbits to the tour date (J2000 for the classic layout):
+
+void
+UpdateBelts(void)
+{
+	if (BeltBodies == 0)
+		return;
+
+	double jd = (TourJulianDate == 0. ? J2000_JD : TourJulianDate) + SimFrame->simTimeMS / (1000. * 60. * 60. * 24.);
+	BeltUpdate(&AsteroidBelt, jd - J2000_JD, &Jobs);
+	BeltUpdate(&KuiperBelt, jd - J2000_JD, &Jobs);
+}
+
+// draw both belts around the sun, scaled from AU to scene units, returning how many bodies were drawn:
+
+int
+DrawBelts(void)
+{
+	if (BeltBodies == 0)
+		return 0;
+
+	float auToScene = (float)(MILES_PER_AU / DistanceScale);
+
+	glPushMatrix();
+	glMultMatrixf(Scene.scene[BodyNode[SunIndex]]);
+	glScalef(auToScene, auToScene, auToScene);
+	int drawn = DrawBelt(&AsteroidBelt, InView + Bodies.n);
+	drawn += DrawBelt(&KuiperBelt, InView + Bodies.n + AsteroidBelt.numClusters);
+	glPopMatrix();
+	return drawn;
+}
+
+// fill the body store from the loaded system description, and load each orbit
+// into the shared ephemeris:
+
+bool
+InitBodies(void)
+{
+	TourLength = 0.;
+	for (int i = 0; i < System.numBodies; i++) {
+		const struct BodyDesc *d = &System.bodies[i];
+		int b = BodyStoreAdd(&Bodies, d->name);
+		Bodies.kind[b] = d->kind;
+		Bodies.parent[b] = d->parent;
+		Bodies.x[b] = d->position[0];
+		Bodies.y[b] = d->position[1];
+		Bodies.z[b] = d->position[2];
+		Bodies.distance[b] = d->distance;
+		Bodies.routeDistance[b] = d->distance;
+		Bodies.offsetY[b] = d->offset[0];
+		Bodies.offsetZ[b] = d->offset[1];
+		Bodies.radius[b] = d->radius;
+		Bodies.rotate[b] = d->rotate_angle;
+		Bodies.slices[b] = d->slices;
+		Bodies.stacks[b] = d->stacks;
+		if (d->hasElements)
+			Bodies.ephemerisIndex[b] = EphemerisAdd(&PlanetEphemeris, &d->orbit);
+
+		if (d->kind == BODY_STAR && SunIndex < 0)
+			SunIndex = b;
+		if (d->parent >= 0 && System.bodies[d->parent].parent < 0 && d->distance > TourLength)
+			TourLength = d->distance;
+	}
+
+	if (SunIndex < 0) {
+		fprintf(stderr, "The system in '%s' has no star\n", SystemFile);
+		return false;
+	}
+
+	PlaceBodies();
+	return true;
+}
+
+// set every body's world position from its parent:
+// children of a root are strung along the route (+x) at their route distance from the ship's start,
+// anything deeper sits its route distance along +x from its parent
+
+void
+PlaceBodies(void)
+{
+	for (int i = 0; i < Bodies.n; i++) {
+		int p = Bodies.parent[i];
+		if (p < 0)
+			continue;		// roots stay where the file put them
+
+		if (Bodies.parent[p] < 0)
+			BodyStoreSetPosition(&Bodies, i, Bodies.routeDistance[i], Bodies.offsetY[i], Bodies.offsetZ[i]);
+		else
+			BodyStoreSetPosition(&Bodies, i, Bodies.x[p] + Bodies.routeDistance[i], Bodies.y[p] + Bodies.offsetY[i], Bodies.z[p] + Bodies.offsetZ[i]);
+	}
+
+	// each body's node sits at its offset from its parent's node:
+	if (BodyNode != NULL) {
+		for (int i = 0; i < Bodies.n; i++) {
+			int p = Bodies.parent[i];
+			if (p < 0)
+				SceneGraphSetTranslation(&Scene, BodyNode[i], Bodies.x[i], Bodies.y[i], Bodies.z[i]);
+			else
+				SceneGraphSetTranslation(&Scene, BodyNode[i], Bodies.x[i] - Bodies.x[p], Bodies.y[i] - Bodies.y[p], Bodies.z[i] - Bodies.z[p]);
+		}
+	}
+}
+
+// build the scene graph: sun -> planets -> moons from the system, and ship -> parts:
+// the ship's parts are modeled in scene units, so their offsets are converted to miles here
+
+void
+InitScene(void)
+{
+	BodyNode = new int[Bodies.n];
+	for (int i = 0; i < Bodies.n; i++)
+		BodyNode[i] = SceneGraphAdd(&Scene, Bodies.parent[i] < 0 ? -1 : BodyNode[Bodies.parent[i]]);
+	PlaceBodies();
+
+	ShipNode = SceneGraphAdd(&Scene, -1);
+	ShipBodyNode = SceneGraphAdd(&Scene, ShipNode);
+	ShipEngineNode = SceneGraphAdd(&Scene, ShipNode);
+	SceneGraphSetTranslation(&Scene, ShipEngineNode, 0., 0., -.05 * DistanceScale);
+	ShipVentLightNode = SceneGraphAdd(&Scene, ShipNode);
+	SceneGraphSetTranslation(&Scene, ShipVentLightNode, 0., 0., -.1 * DistanceScale);
+	ShipVentConeNode = SceneGraphAdd(&Scene, ShipNode);
+	SceneGraphSetTranslation(&Scene, ShipVentConeNode, 0., 0., -.25 * DistanceScale);
+	ShipNoseNode = SceneGraphAdd(&Scene, ShipNode);
+	SceneGraphSetTranslation(&Scene, ShipNoseNode, 0., 0., 1. * DistanceScale);
+}
+
+// pose the ship for this frame, bring the world transforms up to date,
+// and make every node's matrix relative to the ship:
+
+void
+UpdateScene(void)
+{
+	// align spaceship direction with planets, and flip it to back-facing while decelerating
+	float heading = 96.f;
+	if (SimFrame->flip && !SimFrame->forward)
+		heading += 180.f;
+	SceneGraphSetRotationY(&Scene, ShipNode, heading);
+	SceneGraphSetTranslation(&Scene, ShipNode, RenderTravel, 0., 0.);
+
+	SceneGraphUpdate(&Scene);
+	SceneGraphSceneMatrices(&Scene, RenderTravel, 0., 0., DistanceScale);
+}
+
+// load each body's texture, reading every distinct file only once:
+// the files are decoded as jobs, and only the uploads happen here on the main thread
+
+struct TextureDecode
+{
+	const char		*path;
+	unsigned char	*texels;
+	int				width, height;
+};
+
+void
+DecodeTextures(void *data, int first, int last)
+{
+	struct TextureDecode *decodes = (struct TextureDecode *)data;
+	for (int k = first; k < last; k++) {
+		TRACE_ZONE("decode texture");
+		decodes[k].texels = BmpToTexture((char *)decodes[k].path, &decodes[k].width, &decodes[k].height);
+	}
+}
+
+void
+LoadBodyTextures(void)
+{
+	struct TextureDecode *decodes = new struct TextureDecode[Bodies.n];
+	int *which = new int[Bodies.n];			// each body's entry in decodes[ ], -1 for none
+	int numFiles = 0;
+
+	for (int i = 0; i < Bodies.n; i++) {
+		const struct BodyDesc *d = &System.bodies[i];
+		const char *path = (WhichTexture != NORMAL && d->textureHi[0] != '\0') ? d->textureHi : d->texture;
+		which[i] = -1;
+		if (path[0] == '\0')
+			continue;
+
+		int k;
+		for (k = 0; k < numFiles; k++) {
+			if (strcmp(decodes[k].path, path) == 0)
+				break;
+		}
+		if (k == numFiles) {
+			decodes[k].path = path;
+			decodes[k].texels = NULL;
+			numFiles++;
+		}
+		which[i] = k;
+	}
+
+	TRACE_BEGIN(decodeZone, "decode textures");
+	ParallelFor(&Jobs, numFiles, 1, DecodeTextures, decodes);
+	TRACE_END(decodeZone);
+
+	TRACE_ZONE("upload textures");
+	GLuint *names = new GLuint[numFiles > 0 ? numFiles : 1];
+	for (int k = 0; k < numFiles; k++) {
+		glGenTextures(1, &names[k]);
+		glBindTexture(GL_TEXTURE_2D, names[k]);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		if (decodes[k].texels != NULL) {
+			glTexImage2D(GL_TEXTURE_2D, 0, 3, decodes[k].width, decodes[k].height, 0, GL_RGB, GL_UNSIGNED_BYTE, decodes[k].texels);
+			MemAdd(MEM_TEXTURES_GPU, 4LL * decodes[k].width * decodes[k].height);
+			TheMetrics.textures++;
+			MemSub(MEM_TEXTURES, 3LL * decodes[k].width * decodes[k].height);
+		}
+		delete [] decodes[k].texels;
+	}
+	for (int i = 0; i < Bodies.n; i++) {
+		if (which[i] >= 0)
+			Bodies.texture[i] = names[which[i]];
+	}
+
+	delete [] decodes;
+	delete [] which;
+	delete [] names;
+}
+
+// whether this frame's WorldBvh query found the body, counting it in Stats:
+
+bool
+BodyVisible(int i)
+{
+	Stats.bodiesTotal++;
+	if (!InView[i])
+		return false;
+	Stats.bodiesDrawn++;
+	return true;
+}
+
+// frustum-test a ship part's bounding sphere, which is centered cz along the part's z axis:
+
+bool
+ShipPartVisible(int node, float cz, float radius)
+{
+	Stats.partsTotal++;
+	if (!FrustumSphereVisible(&ViewFrustum, Scene.scene[node], 0.f, 0.f, cz, radius))
+		return false;
+	Stats.partsDrawn++;
+	return true;
+}
+
+// draw the culling statistics under the top of the window:
+
+void
+setStatsText(int viewport)
+{
+	// the nearest body around the ship:
+	double origin[3] = { 0., 0., 0. };
+	int numNear = BvhQueryRadius(&WorldBvh, origin, NEARBY_SCENE_RADIUS, BvhHits);
+	int nearest = -1;
+	double nearestDist2 = 0.;
+	for (int h = 0; h < numNear; h++) {
+		int o = BvhHits[h];
+		if (o >= Bodies.n)
+			continue;		// a belt cluster
+		const double *c = WorldCenter[o];
+		double d2 = c[0] * c[0] + c[1] * c[1] + c[2] * c[2];
+		if (nearest < 0 || d2 < nearestDist2) {
+			nearest = o;
+			nearestDist2 = d2;
+		}
+	}
+
+	char nearText[64];
+	if (nearest >= 0)
+		sprintf(nearText, "nearest %s %.1fM mi", Bodies.name[nearest], sqrt(nearestDist2) * DistanceScale / 1.e6);
+	else
+		strcpy(nearText, "nothing near");
+
+	char text[HUD_MAX_CHARS];
+	sprintf(text, "bodies %d/%d  parts %d/%d  stars %d/%d (%d/%d chunks)  belt %d/%d  %s",
+		Stats.bodiesDrawn, Stats.bodiesTotal, Stats.partsDrawn, Stats.partsTotal,
+		Stats.starsDrawn, Stats.starsTotal, Stats.chunksDrawn, Stats.chunksTotal,
+		Stats.clustersDrawn, Stats.clustersTotal, nearText);
+
+	char arenaText[HUD_MAX_CHARS];
+	sprintf(arenaText, "frame arena %.1f KB  peak %.1f KB  (%d threads)",
+		FrameArenaLast / 1024., FrameArenaPeak / 1024., NumFrameArenas);
+
+	const struct LatencyHistogram *lat = &LatencyStages[LAT_TOTAL];
+	char latencyText[HUD_MAX_CHARS];
+	sprintf(latencyText, "input to photon  p50 %.1f  p90 %.1f  p99 %.1f  max %.1f ms  (%d inputs)",
+		LatencyPercentile(lat, .5), LatencyPercentile(lat, .9), LatencyPercentile(lat, .99), lat->maxMS, lat->n);
+
+	const double mb = 1024. * 1024.;
+	char memText[HUD_MAX_CHARS];
+	sprintf(memText, "rss %.0f MB  tex %.0f (gpu %.0f)  mesh %.1f  stars %.1f  other %.1f  untracked %+.1f MB",
+		MemRss / mb, MemCurrent[MEM_TEXTURES] / mb, MemCurrent[MEM_TEXTURES_GPU] / mb, MemCurrent[MEM_MESHES] / mb,
+		MemCurrent[MEM_STARS] / mb, MemCurrent[MEM_OTHER] / mb, (MemUntracked - MemUntrackedBase) / mb);
+
+	if (GlyphAtlasReady) {
+		HudSetText(&StatsHud, 5.f, 95.f, viewport, text);
+		HudDrawString(&StatsHud);
+		HudSetText(&ArenaHud, 5.f, 91.f, viewport, arenaText);
+		HudDrawString(&ArenaHud);
+		HudSetText(&MemHud, 5.f, 87.f, viewport, memText);
+		HudDrawString(&MemHud);
+		HudSetText(&LatencyHud, 5.f, 83.f, viewport, latencyText);
+		HudDrawString(&LatencyHud);
+	}
+	else {
+		DoRasterString(5.f, 95.f, 0.f, text);
+		DoRasterString(5.f, 91.f, 0.f, arenaText);
+		DoRasterString(5.f, 87.f, 0.f, memText);
+		DoRasterString(5.f, 83.f, 0.f, latencyText);
+	}
+}
+
+// what UpdateWorldBvh( ) allocates for n items:
+
+long long
+WorldArrayBytes(int n)
+{
+	return n * (4 * sizeof(double) + 1) + (n > NUM_STAR_CHUNKS ? n : NUM_STAR_CHUNKS) * sizeof(int);
+}
+
+// put every body and belt cluster's bounding sphere, relative to the ship, into WorldBvh
+// and find the ones in the frustum:
+// the tree is built on the first frame and only refit after that, since the objects
+// move but never appear or disappear
+
+void
+UpdateWorldBvh(void)
+{
+	int numAsteroid = BeltBodies > 0 ? AsteroidBelt.numClusters : 0;
+	int numKuiper = BeltBodies > 0 ? KuiperBelt.numClusters : 0;
+	int n = Bodies.n + numAsteroid + numKuiper;
+	if (n != NumWorldItems) {
+		if (WorldCenter != NULL)
+			MemSub(MEM_OTHER, WorldArrayBytes(NumWorldItems));
+		delete [] WorldCenter;
+		delete [] WorldRadius;
+		delete [] InView;
+		delete [] BvhHits;
+		WorldCenter = new double[n][3];
+		WorldRadius = new double[n];
+		InView = new unsigned char[n];
+		BvhHits = new int[n > NUM_STAR_CHUNKS ? n : NUM_STAR_CHUNKS];
+		MemAdd(MEM_OTHER, WorldArrayBytes(n));
+	}
+
+	for (int i = 0; i < Bodies.n; i++) {
+		const float *m = Scene.scene[BodyNode[i]];
+		WorldCenter[i][0] = m[12];
+		WorldCenter[i][1] = m[13];
+		WorldCenter[i][2] = m[14];
+		WorldRadius[i] = Bodies.radiusScaled[i];
+	}
+
+	// the clusters are in AU around the sun, in ecliptic coordinates -- see DrawBelts( ):
+	if (BeltBodies > 0) {
+		const float *m = Scene.scene[BodyNode[SunIndex]];
+		double auToScene = MILES_PER_AU / DistanceScale;
+		for (int b = 0; b < 2; b++) {
+			struct ParticleBelt *belt = b == 0 ? &AsteroidBelt : &KuiperBelt;
+			int first = Bodies.n + (b == 0 ? 0 : numAsteroid);
+			for (int c = 0; c < belt->numClusters; c++) {
+				const float *e = belt->clusterCenter[c];
+				double x = auToScene * e[0], y = auToScene * e[2], z = -auToScene * e[1];
+				for (int k = 0; k < 3; k++)
+					WorldCenter[first + c][k] = m[12 + k] + m[k] * x + m[4 + k] * y + m[8 + k] * z;
+				WorldRadius[first + c] = auToScene * belt->clusterRadius[c];
+			}
+		}
+	}
+
+	if (n != NumWorldItems) {
+		BvhBuild(&WorldBvh, n, WorldCenter, WorldRadius);
+		NumWorldItems = n;
+	}
+	else {
+		BvhRefit(&WorldBvh, WorldCenter, WorldRadius);
+	}
+
+	memset(InView, 0, n);
+	int numVisible = BvhQueryFrustum(&WorldBvh, &ViewFrustum, BvhHits);
+	for (int h = 0; h < numVisible; h++)
+		InView[BvhHits[h]] = 1;
+
+	Stats.clustersTotal = numAsteroid + numKuiper;
+	for (int c = Bodies.n; c < n; c++)
+		Stats.clustersDrawn += InView[c];
+}
+
+// name a WorldBvh object, using buf for the belt clusters:
+
+const char *
+WorldItemName(int item, char *buf)
+{
+	if (item < Bodies.n)
+		return Bodies.name[item];
+	item -= Bodies.n;
+	if (item < AsteroidBelt.numClusters)
+		sprintf(buf, "Asteroid belt cluster %d", item);
+	else
+		sprintf(buf, "Kuiper belt cluster %d", item - AsteroidBelt.numClusters);
+	return buf;
+}
+
+// select the closest object under window pixel (x,y), with a ray through WorldBvh:
+// the ray is built in eye space and taken back through the modelview by hand, since
+// gluUnProject( ) can't be trusted with the reversed-z projection's depths
+
+void
+PickAt(int x, int y)
+{
+	if (NumWorldItems == 0)
+		return;
+
+	const GLdouble *p = PickProjection;
+	const GLint *vp = PickViewport;
+	double ndcX = 2. * (x - vp[0]) / vp[2] - 1.;
+	double ndcY = 2. * ((glutGet(GLUT_WINDOW_HEIGHT) - 1 - y) - vp[1]) / vp[3] - 1.;
+	double eyeOrigin[3], eyeDir[3];
+	if (p[15] == 0.) {		// perspective: from the eye, through the pixel
+		eyeOrigin[0] = eyeOrigin[1] = eyeOrigin[2] = 0.;
+		eyeDir[0] = (ndcX + p[8]) / p[0];
+		eyeDir[1] = (ndcY + p[9]) / p[5];
+		eyeDir[2] = -1.;
+	}
+	else {					// orthographic: straight in from the pixel
+		eyeOrigin[0] = (ndcX - p[12]) / p[0];
+		eyeOrigin[1] = (ndcY - p[13]) / p[5];
+		eyeOrigin[2] = 0.;
+		eyeDir[0] = eyeDir[1] = 0.;
+		eyeDir[2] = -1.;
+	}
+
+	// the modelview is a rotation, a uniform scale, and a translation, so its inverse
+	// is the transpose over the scale squared:
+	const GLdouble *m = PickModelview;
+	double s2 = m[0] * m[0] + m[1] * m[1] + m[2] * m[2];
+	double origin[3], dir[3];
+	for (int k = 0; k < 3; k++) {
+		const double *col = &m[4 * k];
+		origin[k] = (col[0] * (eyeOrigin[0] - m[12]) + col[1] * (eyeOrigin[1] - m[13]) + col[2] * (eyeOrigin[2] - m[14])) / s2;
+		dir[k] = (col[0] * eyeDir[0] + col[1] * eyeDir[1] + col[2] * eyeDir[2]) / s2;
+	}
+
+	double t;
+	PickedItem = BvhQueryRay(&WorldBvh, origin, dir, &t);
+	if (PickedItem >= 0) {
+		char buf[64];
+		const double *c = WorldCenter[PickedItem];
+		fprintf(stderr, "Selected: %s, %.1f million miles from the ship\n", WorldItemName(PickedItem, buf),
+			sqrt(c[0] * c[0] + c[1] * c[1] + c[2] * c[2]) * DistanceScale / 1.e6);
+	}
+}
+
+// name the selected object above the velocity readout:
+
+void
+setPickText(int viewport)
+{
+	char buf[64], text[HUD_MAX_CHARS];
+	const double *c = WorldCenter[PickedItem];
+	sprintf(text, "Selected: %s (%.1fM mi)", WorldItemName(PickedItem, buf),
+		sqrt(c[0] * c[0] + c[1] * c[1] + c[2] * c[2]) * DistanceScale / 1.e6);
+
+	if (GlyphAtlasReady) {
+		HudSetText(&PickHud, 5.f, 10.f, viewport, text);
+		HudDrawString(&PickHud);
+	}
+	else {
+		DoRasterString(5.f, 10.f, 0.f, text);
+	}
+}
+
+// find the star chunks in the frustum, counting them in Stats:
+
+void
+CullStars(void)
+{
+	Stats.chunksTotal = 0;
+	for (int c = 0; c < NUM_STAR_CHUNKS; c++) {
+		if (StarChunkFirst[c + 1] > StarChunkFirst[c])
+			Stats.chunksTotal++;
+	}
+	Stats.starsTotal = StarChunkFirst[NUM_STAR_CHUNKS];
+
+	int visible[NUM_STAR_CHUNKS];
+	int numVisible = BvhQueryFrustum(&SkyBvh, &ViewFrustum, visible);
+	NumVisibleChunks = 0;
+	for (int v = 0; v < numVisible; v++) {
+		int c = visible[v];
+		int count = StarChunkFirst[c + 1] - StarChunkFirst[c];
+		if (count == 0)
+			continue;
+		VisibleChunks[NumVisibleChunks++] = c;
+		Stats.chunksDrawn++;
+		Stats.starsDrawn += count;
+	}
+}
+
+// the frame graphs' jobs, which just call the functions above -- a job takes a void *:
+
+void	PlanetsJob(void *)		{ TRACE_ZONE("planets"); UpdatePlanetPositions(); }
+void	BeltsJob(void *)		{ TRACE_ZONE("belts"); UpdateBelts(); }
+void	SceneJob(void *)		{ TRACE_ZONE("scene graph"); UpdateScene(); }
+void	RefreshJob(void *)		{ TRACE_ZONE("refresh bodies"); BodyStoreRefresh(&Bodies, DistanceScale, RadiusScale); }
+void	WorldBvhJob(void *)		{ TRACE_ZONE("world bvh"); UpdateWorldBvh(); }
+void	StarsJob(void *)		{ TRACE_ZONE("cull stars"); CullStars(); }
+
+// set up the per-frame job graphs:
+// the planets and the belts don't touch each other's data, so they run side by side;
+// the world bvh needs both the posed scene graph and the refreshed radii, while the
+// star chunks need neither
+
+void
+InitFrameGraphs(void)
+{
+	JobGraphInit(&AnimateGraph, &Jobs);
+	JobGraphAdd(&AnimateGraph, PlanetsJob, NULL);
+	JobGraphAdd(&AnimateGraph, BeltsJob, NULL);
+
+	JobGraphInit(&CullGraph, &Jobs);
+	int scene = JobGraphAdd(&CullGraph, SceneJob, NULL);
+	int refresh = JobGraphAdd(&CullGraph, RefreshJob, NULL);
+	int world = JobGraphAdd(&CullGraph, WorldBvhJob, NULL);
+	JobGraphAdd(&CullGraph, StarsJob, NULL);
+	JobGraphDepend(&CullGraph, scene, world);
+	JobGraphDepend(&CullGraph, refresh, world);
+}
@@ -0,0 +1,486 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <vector>
+#include <algorithm>
+
+// scripted benchmark scenarios, for catching performance regressions:
+//
+//	a script names scenarios and says what happens on which frame:
+//
+//		scenario max-speed-to-neptune		# starts a scenario; everything below belongs to it
+//		frames 1800							# frames to draw, at -fps simulated frames a second
+//		warmup 30							# frames left out of the timings (the default)
+//		stars 1000000						# how many stars (default: -stars, or 1000)
+//		tolerance 15						# percent a frame may slow down by before it fails (default 15)
+//		at 0 faster 10						# on frame 0, press the speed-up key 10 times
+//		at 0 place Saturn -20				# put the ship 20 scene units short of saturn
+//		at 300 lightspeed					# faster, slower, lightspeed and reset take a count too
+//		at 0 yrot 45						# set the view's xrot, yrot or scale
+//		sweep 0 600 yrot 0 360				# and vary it linearly from frame 0 to frame 600
+//		capture 0 300 600					# frames to check against golden images (see golden.cpp)
+//
+//	the runner (RunScenarios( ) in sample.cpp) draws every frame on a fixed simulation step and
+//	times it -- the whole frame, gpu included, and each of the main thread's trace zones, which
+//	are the frame's phases
+//	results can be saved as a baseline and later runs compared against it: a scenario fails
+//	when its mean or 95th-percentile frame time is over the baseline by more than its tolerance,
+//	and the phases are listed side by side to show where the time went
+
+#define MAX_SCENARIO_PHASES		24
+#define SCENARIO_NAME_LEN		48
+#define SCENARIO_WARMUP			30
+#define SCENARIO_TOLERANCE		15.			// percent
+#define SCENARIO_NOISE_MS		.05			// a phase must grow by at least this much to be called slower
+
+#define SCN_FASTER				0			// the simulation's commands, count times
+#define SCN_SLOWER				1
+#define SCN_LIGHTSPEED			2
+#define SCN_RESET				3
+#define SCN_PLACE				4			// move the ship to a body, value scene units short of it
+#define SCN_XROT				5
+#define SCN_YROT				6
+#define SCN_SCALE				7
+#define NUM_SCN_ACTIONS			8
+
+static const char *	ScenarioActionNames[NUM_SCN_ACTIONS] = { "faster", "slower", "lightspeed", "reset", "place", "xrot", "yrot", "scale" };
+
+struct ScenarioEvent
+{
+	int		first, last;					// frames; the same for "at"
+	int		action;							// SCN_*
+	int		count;							// for the commands
+	double	from, to;						// the value at first and at last
+	int		body;							// for SCN_PLACE, the system's body number
+};
+
+struct Scenario
+{
+	char	name[ SCENARIO_NAME_LEN ];
+	int		frames;
+	int		warmup;
+	int		stars;							// 0 to leave them alone
+	double	tolerance;						// percent
+	std::vector<struct ScenarioEvent>	events;
+	std::vector<int>	captures;				// frames for -golden
+};
+
+// one phase's timings, a sample a frame:
+
+struct ScenarioPhase
+{
+	char	name[ SCENARIO_NAME_LEN ];		// "frame", or a trace zone's name with _ for spaces
+	std::vector<double>	ms;
+	double	mean, p50, p95, max;
+	double	baseMean, baseP95;				// -1. when the baseline doesn't have it
+};
+
+struct ScenarioResult
+{
+	char	name[ SCENARIO_NAME_LEN ];
+	int		frames;							// that were timed
+	std::vector<struct ScenarioPhase>	phases;		// "frame" first
+	bool	hasBaseline;
+	bool	regressed;
+};
+
+
+// a scenario's events and captures must all be on frames it draws, and it must time at least one:
+// false, with a message, if not
+
+static bool
+CheckScenario( const char *filename, const struct Scenario *s )
+{
+	if( s->warmup >= s->frames )
+	{
+		fprintf( stderr, "%s: scenario '%s' warms up for %d of its %d frames, leaving none to time\n",
+			filename, s->name, s->warmup, s->frames );
+		return false;
+	}
+	for( unsigned int i = 0; i < s->events.size( ); i++ )
+		if( s->events[i].last >= s->frames )
+		{
+			fprintf( stderr, "%s: scenario '%s' has a %s on frame %d, but only draws frames 0-%d\n",
+				filename, s->name, ScenarioActionNames[ s->events[i].action ], s->events[i].last, s->frames - 1 );
+			return false;
+		}
+	for( unsigned int i = 0; i < s->captures.size( ); i++ )
+		if( s->captures[i] >= s->frames )
+		{
+			fprintf( stderr, "%s: scenario '%s' captures frame %d, but only draws frames 0-%d\n",
+				filename, s->name, s->captures[i], s->frames - 1 );
+			return false;
+		}
+	return true;
+}
+
+
+// read a script, false (with a message) if it has a mistake in it:
+// the bodies it places the ship at are looked up in sd
+
+bool
+ReadScenarios( const char *filename, const struct SystemDesc *sd, std::vector<struct Scenario> *scenarios )
+{
+	FILE *fp = fopen( filename, "r" );
+	if( fp == NULL )
+	{
+		fprintf( stderr, "Cannot open scenario script '%s'\n", filename );
+		return false;
+	}
+
+	char line[ 256 ];
+	int lineNum = 0;
+	bool ok = true;
+	while( ok  &&  fgets( line, sizeof(line), fp ) != NULL )
+	{
+		lineNum++;
+		char *hash = strchr( line, '#' );
+		if( hash != NULL )
+			*hash = '\0';
+		char word[ 32 ], what[ 32 ];
+		if( sscanf( line, "%31s", word ) != 1 )
+			continue;
+
+		if( strcmp( word, "scenario" ) == 0 )
+		{
+			struct Scenario s;
+			if( sscanf( line, "%*s %47s", s.name ) != 1 )
+			{
+				ok = false;
+				break;
+			}
+			s.frames = 600;
+			s.warmup = SCENARIO_WARMUP;
+			s.stars = 0;
+			s.tolerance = SCENARIO_TOLERANCE;
+			scenarios->push_back( s );
+			continue;
+		}
+		if( scenarios->empty( ) )
+		{
+			ok = false;
+			break;
+		}
+		struct Scenario *s = &scenarios->back( );
+
+		if( strcmp( word, "frames" ) == 0 )
+			ok = sscanf( line, "%*s %d", &s->frames ) == 1  &&  s->frames > 0;
+		else if( strcmp( word, "warmup" ) == 0 )
+			ok = sscanf( line, "%*s %d", &s->warmup ) == 1  &&  s->warmup >= 0;
+		else if( strcmp( word, "stars" ) == 0 )
+			ok = sscanf( line, "%*s %d", &s->stars ) == 1  &&  s->stars > 0;
+		else if( strcmp( word, "tolerance" ) == 0 )
+			ok = sscanf( line, "%*s %lf", &s->tolerance ) == 1  &&  s->tolerance >= 0.;
+		else if( strcmp( word, "capture" ) == 0 )
+		{
+			// one or more frame numbers, and nothing else:
+			char token[ 32 ];
+			int n;
+			sscanf( line, " %*s%n", &n );
+			const char *p = line + n;
+			ok = false;
+			while( sscanf( p, "%31s%n", token, &n ) == 1 )
+			{
+				char *end;
+				long frame = strtol( token, &end, 10 );
+				ok = *end == '\0'  &&  frame >= 0  &&  frame <= 0x7fffffff;
+				if( ! ok )
+					break;
+				s->captures.push_back( (int)frame );
+				p += n;
+			}
+		}
+		else if( strcmp( word, "at" ) == 0  ||  strcmp( word, "sweep" ) == 0 )
+		{
+			struct ScenarioEvent e;
+			int n;
+			if( word[0] == 'a' )
+			{
+				ok = sscanf( line, "%*s %d %31s%n", &e.first, what, &n ) == 2  &&  e.first >= 0;
+				e.last = e.first;
+			}
+			else
+				ok = sscanf( line, "%*s %d %d %31s%n", &e.first, &e.last, what, &n ) == 3  &&  e.first >= 0  &&  e.last > e.first;
+			if( ! ok )
+				break;
+			const char *rest = line + n;
+
+			e.action = -1;
+			for( int a = 0; a < NUM_SCN_ACTIONS; a++ )
+				if( strcmp( what, ScenarioActionNames[a] ) == 0 )
+					e.action = a;
+			e.count = 1;
+			e.from = e.to = 0.;
+			e.body = -1;
+			switch( e.action )
+			{
+				case SCN_FASTER:
+				case SCN_SLOWER:
+				case SCN_LIGHTSPEED:
+				case SCN_RESET:
+					sscanf( rest, "%d", &e.count );
+					ok = word[0] == 'a'  &&  e.count >= 1  &&  e.count < COMMAND_QUEUE_SIZE;
+					break;
+
+				case SCN_PLACE:
+				{
+					char body[ SYSTEM_NAME_LEN ];
+					ok = word[0] == 'a'  &&  sscanf( rest, "%31s %lf", body, &e.from ) >= 1;
+					if( ok  &&  ( e.body = FindBody( sd, body ) ) < 0 )
+					{
+						fprintf( stderr, "%s, line %d: there's no body '%s' in the system\n", filename, lineNum, body );
+						fclose( fp );
+						return false;
+					}
+					break;
+				}
+
+				case SCN_XROT:
+				case SCN_YROT:
+				case SCN_SCALE:
+					if( word[0] == 'a' )
+					{
+						ok = sscanf( rest, "%lf", &e.from ) == 1;
+						e.to = e.from;
+					}
+					else
+						ok = sscanf( rest, "%lf %lf", &e.from, &e.to ) == 2;
+					break;
+
+				default:
+					ok = false;
+			}
+			if( ok )
+				s->events.push_back( e );
+		}
+		else
+			ok = false;
+	}
+	fclose( fp );
+
+	if( ! ok )
+	{
+		fprintf( stderr, "%s, line %d: can't make sense of '%s'\n", filename, lineNum, strtok( line, "\r\n" ) );
+		return false;
+	}
+	if( scenarios->empty( ) )
+	{
+		fprintf( stderr, "%s has no scenarios in it\n", filename );
+		return false;
+	}
+	for( unsigned int k = 0; k < scenarios->size( ); k++ )
+		if( ! CheckScenario( filename, &(*scenarios)[k] ) )
+			return false;
+	return true;
+}
+
+
+// the phase with this name, added if it isn't there yet with a zero for each frame so far:
+
+struct ScenarioPhase *
+ScenarioGetPhase( struct ScenarioResult *r, const char *name, int frame )
+{
+	char key[ SCENARIO_NAME_LEN ];
+	strncpy( key, name, sizeof(key) - 1 );
+	key[ sizeof(key) - 1 ] = '\0';
+	for( char *c = key; *c != '\0'; c++ )
+		if( isspace( (unsigned char)*c ) )
+			*c = '_';
+
+	for( unsigned int p = 0; p < r->phases.size( ); p++ )
+		if( strcmp( r->phases[p].name, key ) == 0 )
+			return &r->phases[p];
+	if( r->phases.size( ) >= MAX_SCENARIO_PHASES )
+		return NULL;
+
+	struct ScenarioPhase ph;
+	strcpy( ph.name, key );
+	ph.ms.assign( frame, 0. );
+	ph.baseMean = ph.baseP95 = -1.;
+	r->phases.push_back( ph );
+	return &r->phases.back( );
+}
+
+
+// start a frame: every phase gets a zero to add to:
+
+void
+ScenarioBeginFrame( struct ScenarioResult *r )
+{
+	for( unsigned int p = 0; p < r->phases.size( ); p++ )
+		r->phases[p].ms.push_back( 0. );
+	r->frames++;
+}
+
+
+// add ms to this frame's time for the phase:
+
+void
+ScenarioAddTime( struct ScenarioResult *r, const char *name, double ms )
+{
+	struct ScenarioPhase *ph = ScenarioGetPhase( r, name, r->frames - 1 );
+	if( ph == NULL )
+		return;
+	if( (int)ph->ms.size( ) < r->frames )
+		ph->ms.push_back( 0. );
+	ph->ms.back( ) += ms;
+}
+
+
+static double
+ScenarioPercentile( const std::vector<double> &sorted, double p )
+{
+	if( sorted.empty( ) )
+		return 0.;
+	int i = (int)( p * ( sorted.size( ) - 1 ) + .5 );
+	return sorted[i];
+}
+
+
+void
+ScenarioFinish( struct ScenarioResult *r )
+{
+	for( unsigned int p = 0; p < r->phases.size( ); p++ )
+	{
+		struct ScenarioPhase *ph = &r->phases[p];
+		std::vector<double> sorted = ph->ms;
+		std::sort( sorted.begin( ), sorted.end( ) );
+		double sum = 0.;
+		for( unsigned int i = 0; i < sorted.size( ); i++ )
+			sum += sorted[i];
+		ph->mean = sorted.empty( ) ? 0. : sum / sorted.size( );
+		ph->p50 = ScenarioPercentile( sorted, .50 );
+		ph->p95 = ScenarioPercentile( sorted, .95 );
+		ph->max = sorted.empty( ) ? 0. : sorted.back( );
+	}
+}
+
+
+// a baseline file is lines of  scenario phase mean_ms p95_ms :
+// fill in each result's baseline numbers from it, false if it can't be read
+
+bool
+ReadScenarioBaseline( const char *filename, std::vector<struct ScenarioResult> *results )
+{
+	FILE *fp = fopen( filename, "r" );
+	if( fp == NULL )
+	{
+		fprintf( stderr, "Cannot open scenario baseline '%s'\n", filename );
+		return false;
+	}
+	char line[ 256 ], scenario[ SCENARIO_NAME_LEN ], phase[ SCENARIO_NAME_LEN ];
+	double mean, p95;
+	while( fgets( line, sizeof(line), fp ) != NULL )
+	{
+		if( line[0] == '#'  ||  sscanf( line, "%47s %47s %lf %lf", scenario, phase, &mean, &p95 ) != 4 )
+			continue;
+		for( unsigned int s = 0; s < results->size( ); s++ )
+		{
+			struct ScenarioResult *r = &(*results)[s];
+			if( strcmp( r->name, scenario ) != 0 )
+				continue;
+			for( unsigned int p = 0; p < r->phases.size( ); p++ )
+			{
+				if( strcmp( r->phases[p].name, phase ) == 0 )
+				{
+					r->phases[p].baseMean = mean;
+					r->phases[p].baseP95 = p95;
+					r->hasBaseline = true;
+				}
+			}
+		}
+	}
+	fclose( fp );
+	return true;
+}
+
+
+bool
+WriteScenarioBaseline( const char *filename, const std::vector<struct ScenarioResult> &results )
+{
+	FILE *fp = fopen( filename, "w" );
+	if( fp == NULL )
+	{
+		fprintf( stderr, "Cannot write scenario baseline '%s'\n", filename );
+		return false;
+	}
+	fprintf( fp, "# scenario phase mean_ms p95_ms\n" );
+	for( unsigned int s = 0; s < results.size( ); s++ )
+		for( unsigned int p = 0; p < results[s].phases.size( ); p++ )
+			fprintf( fp, "%s %s %.4f %.4f\n", results[s].name, results[s].phases[p].name,
+				results[s].phases[p].mean, results[s].phases[p].p95 );
+	fclose( fp );
+	return true;
+}
+
+
+static double
+ScenarioChange( double now, double base )
+{
+	return base > 0. ? 100. * ( now - base ) / base : 0.;
+}
+
+
+// compare a result with its baseline, and if its frame time is out of the band, say where the
+// time went on fp -- returns true if it regressed
+
+bool
+ScenarioCompare( struct ScenarioResult *r, double tolerance, FILE *fp )
+{
+	r->regressed = false;
+	if( ! r->hasBaseline  ||  r->phases.empty( ) )
+		return false;
+	const struct ScenarioPhase *frame = &r->phases[0];
+	if( frame->baseMean < 0. )
+		return false;
+	double band = 1. + tolerance / 100.;
+	r->regressed = frame->mean > frame->baseMean * band  ||  frame->p95 > frame->baseP95 * band;
+	if( ! r->regressed )
+		return false;
+
+	fprintf( fp, "REGRESSION in scenario '%s': frame mean %.3f ms (baseline %.3f, %+.1f%%), p95 %.3f ms (baseline %.3f, %+.1f%%), tolerance %.0f%%\n",
+		r->name, frame->mean, frame->baseMean, ScenarioChange( frame->mean, frame->baseMean ),
+		frame->p95, frame->baseP95, ScenarioChange( frame->p95, frame->baseP95 ), tolerance );
+	fprintf( fp, "  %-20s %10s %10s %9s %10s %10s %9s\n", "phase (ms)", "base mean", "mean", "change", "base p95", "p95", "change" );
+	for( unsigned int p = 0; p < r->phases.size( ); p++ )
+	{
+		const struct ScenarioPhase *ph = &r->phases[p];
+		if( ph->baseMean < 0. )
+		{
+			fprintf( fp, "  %-20s %10s %10.3f %9s %10s %10.3f %9s  (new)\n", ph->name, "-", ph->mean, "", "-", ph->p95, "" );
+			continue;
+		}
+		bool slower = ph->mean > ph->baseMean * band  &&  ph->mean - ph->baseMean > SCENARIO_NOISE_MS;
+		fprintf( fp, "  %-20s %10.3f %10.3f %+8.1f%% %10.3f %10.3f %+8.1f%%%s\n", ph->name,
+			ph->baseMean, ph->mean, ScenarioChange( ph->mean, ph->baseMean ),
+			ph->baseP95, ph->p95, ScenarioChange( ph->p95, ph->baseP95 ), slower ? "  <--" : "" );
+	}
+	return true;
+}
+
+
+// write  "scenarios": [ ... ]  with no comma or newline after it, each line starting with indent:
+
+void
+ScenarioReportJson( FILE *fp, const char *indent, const std::vector<struct ScenarioResult> &results )
+{
+	fprintf( fp, "%s\"scenarios\": [\n", indent );
+	for( unsigned int s = 0; s < results.size( ); s++ )
+	{
+		const struct ScenarioResult *r = &results[s];
+		fprintf( fp, "%s  { \"name\": \"%s\", \"frames\": %d, \"passed\": %s, \"phases\": {\n", indent, r->name, r->frames,
+			r->regressed ? "false" : "true" );
+		for( unsigned int p = 0; p < r->phases.size( ); p++ )
+		{
+			const struct ScenarioPhase *ph = &r->phases[p];
+			fprintf( fp, "%s    \"%s\": { \"mean_ms\": %.4f, \"p50_ms\": %.4f, \"p95_ms\": %.4f, \"max_ms\": %.4f", indent,
+				ph->name, ph->mean, ph->p50, ph->p95, ph->max );
+			if( ph->baseMean >= 0. )
+				fprintf( fp, ", \"baseline_mean_ms\": %.4f, \"baseline_p95_ms\": %.4f", ph->baseMean, ph->baseP95 );
+			fprintf( fp, " }%s\n", p == r->phases.size( ) - 1 ? "" : "," );
+		}
+		fprintf( fp, "%s  } }%s\n", indent, s == results.size( ) - 1 ? "" : "," );
+	}
+	fprintf( fp, "%s]", indent );
+}
@@ -0,0 +1,162 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+// hierarchical scene graph with cached world transforms:
+//
+//	each node has a parent and a local transform -- a float 3x3 rotation and a double
+//	translation in miles, so a node 30 AU out still places its children to the inch
+//	nodes are stored parent-first, so SceneGraphUpdate( ) is one forward pass: a node's world
+//	transform is only recomputed if its own local transform changed or its parent's world did
+//	SceneGraphSceneMatrices( ) then turns every world transform into a float 4x4 relative to an
+//	eye point, in scene units, for the renderer to glMultMatrixf( ) in bulk
+//	geometry hung on a node is drawn in scene units; only translations are in miles
+
+struct SceneGraph
+{
+	int		n, capacity;
+	int		*parent;				// -1 for a root
+	float	(*localR)[9];			// row-major rotation
+	double	(*localT)[3];			// miles, in the parent's frame
+	float	(*worldR)[9];
+	double	(*worldT)[3];
+	unsigned char	*dirty;			// local transform changed since the last update
+	float	(*scene)[16];			// column-major, for glMultMatrixf( )
+	int		lastUpdated;			// how many world transforms the last update recomputed
+};
+
+
+template <class T>
+static void
+GrowNodes( T **array, int n, int oldCapacity, int capacity )
+{
+	MemAdd( MEM_OTHER, ( capacity - oldCapacity ) * (long long)sizeof(T) );
+	T *grown = new T[ capacity ];
+	if( n > 0 )
+		memcpy( grown, *array, n * sizeof(T) );
+	delete [ ] *array;
+	*array = grown;
+}
+
+
+// add a node with an identity transform, returning its index:
+// the parent must already be in the graph
+
+int
+SceneGraphAdd( struct SceneGraph *sg, int parent )
+{
+	if( sg->n == sg->capacity )
+	{
+		int capacity = sg->capacity == 0 ? 32 : 2 * sg->capacity;
+		GrowNodes( &sg->parent, sg->n, sg->capacity, capacity );
+		GrowNodes( &sg->localR, sg->n, sg->capacity, capacity );
+		GrowNodes( &sg->localT, sg->n, sg->capacity, capacity );
+		GrowNodes( &sg->worldR, sg->n, sg->capacity, capacity );
+		GrowNodes( &sg->worldT, sg->n, sg->capacity, capacity );
+		GrowNodes( &sg->dirty, sg->n, sg->capacity, capacity );
+		GrowNodes( &sg->scene, sg->n, sg->capacity, capacity );
+		sg->capacity = capacity;
+	}
+
+	int i = sg->n++;
+	sg->parent[i] = parent;
+	static const float identity[9] = { 1.f, 0.f, 0.f,  0.f, 1.f, 0.f,  0.f, 0.f, 1.f };
+	memcpy( sg->localR[i], identity, sizeof(identity) );
+	sg->localT[i][0] = sg->localT[i][1] = sg->localT[i][2] = 0.;
+	sg->dirty[i] = 1;
+	return i;
+}
+
+
+inline
+void
+SceneGraphSetTranslation( struct SceneGraph *sg, int i, double x, double y, double z )
+{
+	double *t = sg->localT[i];
+	if( t[0] != x  ||  t[1] != y  ||  t[2] != z )
+	{
+		t[0] = x;
+		t[1] = y;
+		t[2] = z;
+		sg->dirty[i] = 1;
+	}
+}
+
+
+// set a node's local rotation to deg degrees about the y axis:
+
+void
+SceneGraphSetRotationY( struct SceneGraph *sg, int i, float deg )
+{
+	float c = cosf( deg * (float)M_PI / 180.f );
+	float s = sinf( deg * (float)M_PI / 180.f );
+	float r[9] = { c, 0.f, s,  0.f, 1.f, 0.f,  -s, 0.f, c };
+	if( memcmp( r, sg->localR[i], sizeof(r) ) != 0 )
+	{
+		memcpy( sg->localR[i], r, sizeof(r) );
+		sg->dirty[i] = 1;
+	}
+}
+
+
+// bring the world transforms up to date, touching only the changed subtrees:
+
+void
+SceneGraphUpdate( struct SceneGraph *sg )
+{
+	int updated = 0;
+	for( int i = 0; i < sg->n; i++ )
+	{
+		int p = sg->parent[i];
+		if( p >= 0  &&  sg->dirty[p] )
+			sg->dirty[i] = 1;		// parents come first, so this propagates down the tree
+		if( ! sg->dirty[i] )
+			continue;
+
+		const float  *lr = sg->localR[i];
+		const double *lt = sg->localT[i];
+		float  *wr = sg->worldR[i];
+		double *wt = sg->worldT[i];
+		if( p < 0 )
+		{
+			memcpy( wr, lr, 9 * sizeof(float) );
+			wt[0] = lt[0];	wt[1] = lt[1];	wt[2] = lt[2];
+		}
+		else
+		{
+			const float  *pr = sg->worldR[p];
+			const double *pt = sg->worldT[p];
+			for( int r = 0; r < 3; r++ )
+			{
+				for( int c = 0; c < 3; c++ )
+					wr[3*r+c] = pr[3*r+0]*lr[0+c] + pr[3*r+1]*lr[3+c] + pr[3*r+2]*lr[6+c];
+				wt[r] = pt[r] + pr[3*r+0]*lt[0] + pr[3*r+1]*lt[1] + pr[3*r+2]*lt[2];
+			}
+		}
+		updated++;
+	}
+
+	// the dirty flags were read top-down above, so only clear them once every child has seen them:
+	memset( sg->dirty, 0, sg->n );
+	sg->lastUpdated = updated;
+}
+
+
+// fill sg->scene[ ] with every node's transform relative to the eye, in scene units:
+// the translation difference is taken in double, so only a small number is narrowed to float
+
+void
+SceneGraphSceneMatrices( struct SceneGraph *sg, double eyeX, double eyeY, double eyeZ, double milesPerUnit )
+{
+	const double inv = 1. / milesPerUnit;
+	for( int i = 0; i < sg->n; i++ )
+	{
+		const float  *r = sg->worldR[i];
+		const double *t = sg->worldT[i];
+		float *m = sg->scene[i];
+		m[0] = r[0];	m[4] = r[1];	m[8]  = r[2];	m[12] = (float)( ( t[0] - eyeX ) * inv );
+		m[1] = r[3];	m[5] = r[4];	m[9]  = r[5];	m[13] = (float)( ( t[1] - eyeY ) * inv );
+		m[2] = r[6];	m[6] = r[7];	m[10] = r[8];	m[14] = (float)( ( t[2] - eyeZ ) * inv );
+		m[3] = 0.f;		m[7] = 0.f;		m[11] = 0.f;	m[15] = 1.f;
+	}
+}
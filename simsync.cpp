@@ -0,0 +1,126 @@
+#include <stdio.h>
+#include <atomic>
+
+// lock-free hand-off between the simulation thread and the render thread:
+//
+//	TripleBuffer	the simulation writes a whole snapshot into its back slot and publishes it by
+//					swapping that slot with the middle one; the renderer takes the newest snapshot by
+//					swapping its front slot with the middle one -- one atomic exchange each, so
+//					neither side ever waits for the other, and a slot is only ever touched by one side
+//	CommandQueue	a single-producer, single-consumer ring of ints for input going the other way
+//
+//	both are for exactly one writer thread and one reader thread
+
+#define TRIPLE_FRESH		4			// set in TripleBuffer.middle when it holds an unread snapshot
+
+template <class T>
+struct TripleBuffer
+{
+	T				slots[3];
+	std::atomic<int>	middle;			// slot index, | TRIPLE_FRESH
+	int				back;				// the writer's
+	int				front;				// the reader's
+};
+
+
+template <class T>
+void
+TripleBufferInit( struct TripleBuffer<T> *tb )
+{
+	tb->back = 0;
+	tb->middle = 1;
+	tb->front = 2;
+}
+
+
+// the slot the writer should fill next:
+
+template <class T>
+inline
+T *
+TripleBufferBack( struct TripleBuffer<T> *tb )
+{
+	return &tb->slots[ tb->back ];
+}
+
+
+// publish the back slot:
+// release, so the snapshot's contents are visible before the reader can get the index
+
+template <class T>
+void
+TripleBufferPublish( struct TripleBuffer<T> *tb )
+{
+	int old = tb->middle.exchange( tb->back | TRIPLE_FRESH, std::memory_order_acq_rel );
+	tb->back = old & ~TRIPLE_FRESH;
+}
+
+
+// the newest published snapshot -- the same one as last time if nothing new was published:
+// it stays valid, and unchanged, until the next call
+
+template <class T>
+const T *
+TripleBufferRead( struct TripleBuffer<T> *tb )
+{
+	if( ( tb->middle.load( std::memory_order_relaxed ) & TRIPLE_FRESH ) != 0 )
+	{
+		int old = tb->middle.exchange( tb->front, std::memory_order_acq_rel );
+		tb->front = old & ~TRIPLE_FRESH;
+	}
+	return &tb->slots[ tb->front ];
+}
+
+
+#define COMMAND_QUEUE_SIZE		64		// a power of 2
+
+struct CommandQueue
+{
+	int		items[ COMMAND_QUEUE_SIZE ];
+	std::atomic<unsigned int>	head;	// next to pop, only the consumer moves it
+	std::atomic<unsigned int>	tail;	// next to push, only the producer moves it
+};
+
+
+void
+CommandQueueInit( struct CommandQueue *q )
+{
+	q->head = 0;
+	q->tail = 0;
+}
+
+
+// false if the queue is full:
+
+bool
+CommandQueuePush( struct CommandQueue *q, int item )
+{
+	unsigned int tail = q->tail.load( std::memory_order_relaxed );
+	if( tail - q->head.load( std::memory_order_acquire ) == COMMAND_QUEUE_SIZE )
+		return false;
+	q->items[ tail % COMMAND_QUEUE_SIZE ] = item;
+	q->tail.store( tail + 1, std::memory_order_release );
+	return true;
+}
+
+
+// false if the queue is empty:
+
+bool
+CommandQueuePop( struct CommandQueue *q, int *item )
+{
+	unsigned int head = q->head.load( std::memory_order_relaxed );
+	if( head == q->tail.load( std::memory_order_acquire ) )
+		return false;
+	*item = q->items[ head % COMMAND_QUEUE_SIZE ];
+	q->head.store( head + 1, std::memory_order_release );
+	return true;
+}
+
+
+inline
+bool
+CommandQueueEmpty( struct CommandQueue *q )
+{
+	return q->head.load( std::memory_order_acquire ) == q->tail.load( std::memory_order_acquire );
+}
@@ -0,0 +1,338 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// star system description files:
+//
+//	a system is a list of bodies, parents before children, read from either
+//	  - a text file, one "body NAME" line followed by "key value ..." lines per body
+//	    (see Solar_system/sol.txt for every key), or
+//	  - the binary form written by WriteSystemBinary( ): a header and the BodyDesc array
+//	    exactly as it sits in memory, so loading it is one MapFile( ) and no parsing
+//	LoadSystem( ) tells them apart by the magic number
+
+#define SYSTEM_MAGIC		0x53595353		// "SSYS"
+#define SYSTEM_VERSION		1
+#define SYSTEM_NAME_LEN		32
+#define SYSTEM_PATH_LEN		128
+
+enum BodyKinds
+{
+	BODY_STAR,
+	BODY_PLANET
+};
+
+struct BodyDesc
+{
+	char	name[SYSTEM_NAME_LEN];
+	int		parent;							// index of the parent body, -1 for the root star
+	int		kind;							// BODY_STAR or BODY_PLANET
+	double	position[3];					// miles, root bodies only
+	double	distance;						// miles from the parent
+	double	offset[2];						// y and z miles off the route, so bodies aren't all in a line
+	float	radius;							// miles
+	float	rotate_angle;					// degrees about y
+	int		slices, stacks;					// sphere tessellation
+	int		hasElements;					// != 0 if orbit is filled in
+	struct OrbitalElements orbit;
+	char	texture[SYSTEM_PATH_LEN];		// bmp file
+	char	textureHi[SYSTEM_PATH_LEN];		// used instead when high-res textures are on, may be empty
+};
+
+struct SystemHeader
+{
+	int		magic;
+	int		version;
+	int		numBodies;
+	int		bodySize;						// sizeof(struct BodyDesc), so a mismatched build is caught
+};
+
+struct SystemDesc
+{
+	int					numBodies;
+	const struct BodyDesc	*bodies;		// points into owned[ ] or into the mapped file
+	struct BodyDesc		*owned;				// parsed from text, NULL if mapped
+	struct MappedFile	file;
+};
+
+
+// find a body by name, -1 if it isn't there:
+
+int
+FindBody( const struct SystemDesc *sd, const char *name )
+{
+	for( int i = 0; i < sd->numBodies; i++ )
+		if( strcmp( sd->bodies[i].name, name ) == 0 )
+			return i;
+	return -1;
+}
+
+
+// a checksum (fnv-1a) of the bodies' names and orbits, in order -- what decides which body is
+// which ephemeris slot, so a file built from one system can tell it isn't being used with another:
+
+unsigned int
+SystemChecksum( const struct SystemDesc *sd )
+{
+	unsigned int sum = 2166136261u;
+	for( int i = 0; i < sd->numBodies; i++ )
+	{
+		const struct BodyDesc *b = &sd->bodies[i];
+		const unsigned char *p = (const unsigned char *)b->name;
+		for( int k = 0; p[k] != '\0'; k++ )
+			sum = ( sum ^ p[k] ) * 16777619u;
+		sum = ( sum ^ ( b->hasElements ? 1 : 0 ) ) * 16777619u;
+		if( b->hasElements )
+		{
+			p = (const unsigned char *)&b->orbit;
+			for( size_t k = 0; k < sizeof(b->orbit); k++ )
+				sum = ( sum ^ p[k] ) * 16777619u;
+		}
+	}
+	return sum;
+}
+
+
+void
+FreeSystem( struct SystemDesc *sd )
+{
+	delete [ ] sd->owned;
+	UnmapFile( &sd->file );
+	memset( sd, 0, sizeof(*sd) );
+}
+
+
+// copy a path or name argument, which runs to the end of the line:
+
+static void
+CopyField( char *dst, const char *src, int len )
+{
+	while( *src == ' '  ||  *src == '\t' )
+		src++;
+	int n = 0;
+	while( src[n] != '\0'  &&  src[n] != '\n'  &&  src[n] != '\r'  &&  src[n] != '#'  &&  n < len-1 )
+	{
+		dst[n] = src[n];
+		n++;
+	}
+	while( n > 0  &&  ( dst[n-1] == ' '  ||  dst[n-1] == '\t' ) )
+		n--;
+	dst[n] = '\0';
+}
+
+
+// parse a text description:
+// returns false, with a message naming the line, on anything it doesn't understand
+
+bool
+ParseSystemText( struct SystemDesc *sd, FILE *fp, const char *filename )
+{
+	int capacity = 16;
+	sd->owned = new struct BodyDesc[ capacity ];
+	sd->bodies = sd->owned;
+	sd->numBodies = 0;
+
+	char line[ 512 ];
+	int lineNum = 0;
+	struct BodyDesc *b = NULL;
+	while( fgets( line, sizeof(line), fp ) != NULL )
+	{
+		lineNum++;
+		char key[ 32 ];
+		int used;
+		if( sscanf( line, " %31s%n", key, &used ) != 1  ||  key[0] == '#' )
+			continue;
+		const char *args = line + used;
+
+		if( strcmp( key, "body" ) == 0 )
+		{
+			if( sd->numBodies == capacity )
+			{
+				struct BodyDesc *grown = new struct BodyDesc[ 2 * capacity ];
+				memcpy( grown, sd->owned, capacity * sizeof(struct BodyDesc) );
+				delete [ ] sd->owned;
+				sd->owned = grown;
+				sd->bodies = grown;
+				capacity *= 2;
+			}
+			b = &sd->owned[ sd->numBodies++ ];
+			memset( b, 0, sizeof(*b) );
+			CopyField( b->name, args, SYSTEM_NAME_LEN );
+			b->parent = -1;
+			b->kind = BODY_PLANET;
+			b->slices = b->stacks = 30;
+			continue;
+		}
+
+		if( b == NULL )
+		{
+			fprintf( stderr, "%s:%d: '%s' before the first body\n", filename, lineNum, key );
+			return false;
+		}
+
+		bool ok = true;
+		if( strcmp( key, "kind" ) == 0 )
+		{
+			char kind[ 32 ];
+			ok = sscanf( args, "%31s", kind ) == 1  &&  ( strcmp( kind, "star" ) == 0  ||  strcmp( kind, "planet" ) == 0 );
+			if( ok )
+				b->kind = strcmp( kind, "star" ) == 0 ? BODY_STAR : BODY_PLANET;
+		}
+		else if( strcmp( key, "parent" ) == 0 )
+		{
+			char name[ SYSTEM_NAME_LEN ];
+			CopyField( name, args, SYSTEM_NAME_LEN );
+			b->parent = FindBody( sd, name );
+			ok = b->parent >= 0  &&  b->parent < sd->numBodies - 1;		// parents come first
+		}
+		else if( strcmp( key, "position" ) == 0 )
+			ok = sscanf( args, "%lf %lf %lf", &b->position[0], &b->position[1], &b->position[2] ) == 3;
+		else if( strcmp( key, "distance" ) == 0 )
+			ok = sscanf( args, "%lf", &b->distance ) == 1;
+		else if( strcmp( key, "offset" ) == 0 )
+			ok = sscanf( args, "%lf %lf", &b->offset[0], &b->offset[1] ) == 2;
+		else if( strcmp( key, "radius" ) == 0 )
+			ok = sscanf( args, "%f", &b->radius ) == 1;
+		else if( strcmp( key, "rotate" ) == 0 )
+			ok = sscanf( args, "%f", &b->rotate_angle ) == 1;
+		else if( strcmp( key, "lod" ) == 0 )
+			ok = sscanf( args, "%d %d", &b->slices, &b->stacks ) == 2  &&  b->slices >= 3  &&  b->stacks >= 2;
+		else if( strcmp( key, "texture" ) == 0 )
+			CopyField( b->texture, args, SYSTEM_PATH_LEN );
+		else if( strcmp( key, "texture_hi" ) == 0 )
+			CopyField( b->textureHi, args, SYSTEM_PATH_LEN );
+		else if( strcmp( key, "elements" ) == 0 )
+		{
+			struct OrbitalElements *o = &b->orbit;
+			ok = sscanf( args, "%lf %lf %lf %lf %lf %lf", &o->a, &o->e, &o->inc, &o->L, &o->wbar, &o->node ) == 6;
+			b->hasElements = ok;
+		}
+		else if( strcmp( key, "rates" ) == 0 )
+		{
+			struct OrbitalElements *o = &b->orbit;
+			ok = sscanf( args, "%lf %lf %lf %lf %lf %lf", &o->da, &o->de, &o->dinc, &o->dL, &o->dwbar, &o->dnode ) == 6;
+		}
+		else
+		{
+			fprintf( stderr, "%s:%d: unknown key '%s'\n", filename, lineNum, key );
+			return false;
+		}
+
+		if( ! ok )
+		{
+			fprintf( stderr, "%s:%d: bad value for '%s'\n", filename, lineNum, key );
+			return false;
+		}
+	}
+
+	if( sd->numBodies == 0  ||  sd->bodies[0].parent != -1 )
+	{
+		fprintf( stderr, "%s: the first body must be the root (no parent)\n", filename );
+		return false;
+	}
+	return true;
+}
+
+
+// a binary system is trusted no further than the text one is -- the same checks the parser makes,
+// body by body, false (with a message naming the body) on the first that fails:
+
+static bool
+CheckSystemBodies( const struct SystemDesc *sd, const char *filename )
+{
+	for( int i = 0; i < sd->numBodies; i++ )
+	{
+		const struct BodyDesc *b = &sd->bodies[i];
+		const char *bad = NULL;
+		if( memchr( b->name, '\0', SYSTEM_NAME_LEN ) == NULL )
+			bad = "name";
+		else if( memchr( b->texture, '\0', SYSTEM_PATH_LEN ) == NULL  ||  memchr( b->textureHi, '\0', SYSTEM_PATH_LEN ) == NULL )
+			bad = "texture";
+		else if( i == 0 ? b->parent != -1 : ( b->parent < -1  ||  b->parent >= i ) )		// parents come first
+			bad = "parent";
+		else if( b->kind != BODY_STAR  &&  b->kind != BODY_PLANET )
+			bad = "kind";
+		else if( b->slices < 3  ||  b->stacks < 2 )
+			bad = "lod";
+		if( bad != NULL )
+		{
+			fprintf( stderr, "'%s': body %d has a bad %s, recompile it with -compilesystem\n", filename, i, bad );
+			return false;
+		}
+	}
+	return true;
+}
+
+
+// load a system description, binary or text:
+
+bool
+LoadSystem( struct SystemDesc *sd, const char *filename )
+{
+	memset( sd, 0, sizeof(*sd) );
+	if( ! MapFile( &sd->file, filename ) )
+		return false;
+
+	const struct SystemHeader *h = (const struct SystemHeader *)sd->file.base;
+	if( sd->file.size >= sizeof(*h)  &&  h->magic == SYSTEM_MAGIC )
+	{
+		if( h->version != SYSTEM_VERSION  ||  h->bodySize != (int)sizeof(struct BodyDesc)
+			||  h->numBodies < 1  ||  sd->file.size < sizeof(*h) + (size_t)h->numBodies * sizeof(struct BodyDesc) )
+		{
+			fprintf( stderr, "'%s' was compiled by a different version, recompile it with -compilesystem\n", filename );
+			FreeSystem( sd );
+			return false;
+		}
+		sd->numBodies = h->numBodies;
+		sd->bodies = (const struct BodyDesc *)( h + 1 );
+		if( ! CheckSystemBodies( sd, filename ) )
+		{
+			FreeSystem( sd );
+			return false;
+		}
+		return true;
+	}
+
+	// not binary -- parse it as text:
+
+	UnmapFile( &sd->file );
+	FILE *fp = fopen( filename, "r" );
+	if( fp == NULL )
+	{
+		fprintf( stderr, "Cannot open system file '%s'\n", filename );
+		return false;
+	}
+	bool ok = ParseSystemText( sd, fp, filename );
+	fclose( fp );
+	if( ! ok )
+		FreeSystem( sd );
+	return ok;
+}
+
+
+// write the binary form of a loaded system:
+
+bool
+WriteSystemBinary( const struct SystemDesc *sd, const char *filename )
+{
+	FILE *fp = fopen( filename, "wb" );
+	if( fp == NULL )
+	{
+		fprintf( stderr, "Cannot write system file '%s'\n", filename );
+		return false;
+	}
+
+	struct SystemHeader h;
+	h.magic     = SYSTEM_MAGIC;
+	h.version   = SYSTEM_VERSION;
+	h.numBodies = sd->numBodies;
+	h.bodySize  = (int)sizeof(struct BodyDesc);
+	fwrite( &h, sizeof(h), 1, fp );
+	fwrite( sd->bodies, sizeof(struct BodyDesc), sd->numBodies, fp );
+
+	bool ok = ferror( fp ) == 0;
+	fclose( fp );
+	if( ! ok )
+		fprintf( stderr, "Error writing system file '%s'\n", filename );
+	return ok;
+}
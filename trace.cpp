@@ -0,0 +1,237 @@
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <chrono>
+
+// timeline tracing, written as chrome trace-event json (open it in ui.perfetto.dev or chrome://tracing):
+//
+//	TRACE_ZONE( "name" ) times from there to the end of the enclosing block;
+//	TRACE_BEGIN( var, "name" ) ... TRACE_END( var ) times a stretch of a longer function
+//	names must be string literals -- only the pointer is kept
+//	each thread appends finished zones to its own buffer, which only it writes, so recording
+//	takes no locks (a lock is taken once per thread, to register the buffer); when a buffer
+//	fills up, later zones on that thread are dropped and counted
+//	nothing is recorded until TraceStart( ); TraceWrite( ) stops and writes the file
+//	TraceStart( NULL ) records for code in this process that totals its own thread's zones
+//	(TraceThreadEvents( ) -- the scenario runner does), and writes nothing
+//	zones are only cpu time: a gl call that returns has just been queued
+//
+//	comment out ENABLE_TRACE to compile every zone away
+
+#define ENABLE_TRACE
+
+#define TRACE_BUFFER_EVENTS		(256*1024)		// per thread, about 4 minutes of frames
+
+struct TraceEvent
+{
+	const char *	name;
+	long long		start, end;			// ns since TraceStart( )
+};
+
+struct TraceBuffer
+{
+	int					tid;
+	char				threadName[ 32 ];
+	std::atomic<int>	count;			// events[0..count) are finished
+	int					dropped;
+	struct TraceEvent	events[ TRACE_BUFFER_EVENTS ];
+};
+
+std::atomic<bool>		TraceOn;
+const char *			TraceFile;
+std::chrono::steady_clock::time_point	TraceEpoch;
+std::mutex				TraceLock;			// guards TraceBuffers
+std::vector<struct TraceBuffer *>	TraceBuffers;
+static thread_local struct TraceBuffer *	TraceThreadBuffer;
+
+
+inline
+long long
+TraceNow( )
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now( ) - TraceEpoch ).count( );
+}
+
+
+static struct TraceBuffer *
+TraceGetBuffer( )
+{
+	if( TraceThreadBuffer == NULL )
+	{
+		struct TraceBuffer *tb = new struct TraceBuffer;
+		tb->count = 0;
+		tb->dropped = 0;
+		strcpy( tb->threadName, "thread" );
+		MemAdd( MEM_OTHER, sizeof(struct TraceBuffer) );
+
+		std::lock_guard<std::mutex> guard( TraceLock );
+		tb->tid = (int)TraceBuffers.size( ) + 1;
+		TraceBuffers.push_back( tb );
+		TraceThreadBuffer = tb;
+	}
+	return TraceThreadBuffer;
+}
+
+
+void
+TraceRecord( const char *name, long long start, long long end )
+{
+	struct TraceBuffer *tb = TraceGetBuffer( );
+	int c = tb->count.load( std::memory_order_relaxed );
+	if( c >= TRACE_BUFFER_EVENTS )
+	{
+		tb->dropped++;
+		return;
+	}
+	tb->events[c].name = name;
+	tb->events[c].start = start;
+	tb->events[c].end = end;
+	tb->count.store( c + 1, std::memory_order_release );		// the writer can now see it
+}
+
+
+// label the calling thread's track:
+
+void
+TraceThreadName( const char *name )
+{
+	if( ! TraceOn )
+		return;
+	struct TraceBuffer *tb = TraceGetBuffer( );
+	strncpy( tb->threadName, name, sizeof(tb->threadName) - 1 );
+	tb->threadName[ sizeof(tb->threadName) - 1 ] = '\0';
+}
+
+
+struct TraceZone
+{
+	const char *	name;			// NULL when not recording
+	long long		start;
+
+	TraceZone( const char *n )
+	{
+		name = TraceOn.load( std::memory_order_relaxed ) ? n : NULL;
+		if( name != NULL )
+			start = TraceNow( );
+	}
+
+	void
+	End( )
+	{
+		if( name != NULL )
+			TraceRecord( name, start, TraceNow( ) );
+		name = NULL;
+	}
+
+	~TraceZone( )
+	{
+		End( );
+	}
+};
+
+
+// start recording, to be written to filename (NULL to write nothing):
+
+void
+TraceStart( const char *filename )
+{
+	TraceFile = filename;
+	TraceEpoch = std::chrono::steady_clock::now( );
+	TraceOn = true;
+}
+
+
+// stop recording and write the file -- call once the other threads have stopped:
+
+void
+TraceWrite( )
+{
+	if( ! TraceOn )
+		return;
+	TraceOn = false;
+	if( TraceFile == NULL )
+		return;
+
+	FILE *fp = fopen( TraceFile, "w" );
+	if( fp == NULL )
+	{
+		fprintf( stderr, "Cannot write the trace to '%s'\n", TraceFile );
+		return;
+	}
+
+	std::lock_guard<std::mutex> guard( TraceLock );
+	fprintf( fp, "{ \"displayTimeUnit\": \"ms\", \"traceEvents\": [\n" );
+	const char *sep = "";
+	int numEvents = 0, numDropped = 0;
+	for( unsigned int b = 0; b < TraceBuffers.size( ); b++ )
+	{
+		struct TraceBuffer *tb = TraceBuffers[b];
+		fprintf( fp, "%s{ \"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": { \"name\": \"%s\" } }",
+			sep, tb->tid, tb->threadName );
+		sep = ",\n";
+
+		int count = tb->count.load( std::memory_order_acquire );
+		for( int i = 0; i < count; i++ )
+		{
+			const struct TraceEvent *e = &tb->events[i];
+			fprintf( fp, "%s{ \"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f }",
+				sep, e->name, tb->tid, e->start / 1000., ( e->end - e->start ) / 1000. );
+		}
+		numEvents += count;
+		numDropped += tb->dropped;
+	}
+	fprintf( fp, "\n] }\n" );
+	fclose( fp );
+
+	fprintf( stderr, "Wrote %d trace events to '%s'\n", numEvents, TraceFile );
+	if( numDropped > 0 )
+		fprintf( stderr, "(%d more were dropped when the per-thread buffers filled up)\n", numDropped );
+}
+
+
+// the calling thread's finished zones, and how many there are:
+
+const struct TraceEvent *
+TraceThreadEvents( int *count )
+{
+	struct TraceBuffer *tb = TraceGetBuffer( );
+	*count = tb->count.load( std::memory_order_relaxed );
+	return tb->events;
+}
+
+
+// how many of the calling thread's zones didn't fit in its buffer:
+
+int
+TraceThreadDropped( )
+{
+	return TraceGetBuffer( )->dropped;
+}
+
+
+// forget the calling thread's zones, so a long run doesn't fill its buffer -- only when
+// nothing is going to be written:
+
+void
+TraceThreadRewind( )
+{
+	if( TraceFile == NULL )
+		TraceGetBuffer( )->count.store( 0, std::memory_order_relaxed );
+}
+
+
+#ifdef ENABLE_TRACE
+#define TRACE_CONCAT2( a, b )		a##b
+#define TRACE_CONCAT( a, b )		TRACE_CONCAT2( a, b )
+#define TRACE_ZONE( name )			struct TraceZone TRACE_CONCAT( traceZone, __LINE__ )( name )
+#define TRACE_BEGIN( var, name )	struct TraceZone var( name )
+#define TRACE_END( var )			var.End( )
+#define TRACE_THREAD_NAME( name )	TraceThreadName( name )
+#else
+#define TRACE_ZONE( name )
+#define TRACE_BEGIN( var, name )
+#define TRACE_END( var )
+#define TRACE_THREAD_NAME( name )
+#endif
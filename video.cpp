@@ -0,0 +1,382 @@
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <chrono>
+
+#ifdef WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+// offline rendering to video:
+//
+//	frames drawn offscreen go through a pipeline, so the gpu never waits on us and we only
+//	wait on it for frames it finished long ago:
+//		VideoCapture( )		starts an asynchronous glReadPixels( ) of the frame just drawn into
+//							the next pixel buffer object of a ring of VIDEO_PBOS; the frame that
+//							pbo held, VIDEO_PBOS frames back, is mapped and copied out first
+//		the writer thread	takes the copies in order, converts them (bgra, bottom-up) to the
+//							output's format with its own job system, a band of rows per job,
+//							and writes them
+//	a bounded pool of VIDEO_BUFFERS copies holds the main thread back if writing falls behind,
+//	rather than letting memory grow
+//	the output is a raw stream, to a file or stdout ("-"):
+//		.ppm	one binary ppm after another (ffmpeg -f image2pipe -c:v ppm -i ...)
+//		else	yuv4mpeg2, 4:2:0, bt.601 limited range (ffmpeg -i file.y4m, or mpv, directly)
+//	without pixel buffer objects each frame is read synchronously, which is slower but the same
+//	(not all gl 2.1 drivers have them)
+
+#define VIDEO_PBOS			3
+#define VIDEO_BUFFERS		4
+#define VIDEO_BAND_ROWS		32			// rows converted per job
+
+#define VIDEO_Y4M			0
+#define VIDEO_PPM			1
+
+struct VideoWriter
+{
+	FILE *			fp;
+	int				format;
+	int				width, height, fps;
+	int				numThreads;				// for converting, 0 for one per core
+	size_t			outBytes;			// a converted frame, header not included
+
+	// main thread only:
+	bool			usePbos;
+	GLuint			pbos[VIDEO_PBOS];
+	bool			pending[VIDEO_PBOS];	// a read into pbos[k] hasn't been collected
+	int				next;					// the pbo the next frame goes into
+	double			mapWaitMS;				// waiting for the gpu to finish an old frame
+	double			stallMS;				// waiting for the writer to free a buffer
+	long long		framesCaptured;
+
+	// shared with the writer thread, under lock:
+	std::mutex		lock;
+	std::condition_variable	changed;
+	std::vector<unsigned char *>	free;
+	std::deque<unsigned char *>		full;		// oldest first
+	bool			finished;				// no more frames are coming
+	bool			failed;					// a write failed, or a frame couldn't be read back
+	long long		framesWritten;
+
+	std::thread		thread;
+	struct JobSystem	jobs;				// started by the writer thread, for converting
+	unsigned char *	out;
+};
+
+struct VideoWriter	Video;
+const char *		VideoFile;				// set with -video
+
+
+// convert source rows (bgra, bottom row first) into the output's rows -- a ParallelFor( ) range
+// over bands of VIDEO_BAND_ROWS output rows:
+
+struct VideoConvertJob
+{
+	const unsigned char *	bgra;
+	struct VideoWriter *	v;
+};
+
+static void
+VideoConvertRows( void *data, int first, int last )
+{
+	struct VideoConvertJob *job = (struct VideoConvertJob *)data;
+	const struct VideoWriter *v = job->v;
+	int w = v->width, h = v->height;
+	int y0 = first * VIDEO_BAND_ROWS;
+	int y1 = last * VIDEO_BAND_ROWS < h ? last * VIDEO_BAND_ROWS : h;
+
+	if( v->format == VIDEO_PPM )
+	{
+		for( int y = y0; y < y1; y++ )
+		{
+			const unsigned char *src = job->bgra + (size_t)( h - 1 - y ) * w * 4;
+			unsigned char *dst = v->out + (size_t)y * w * 3;
+			for( int x = 0; x < w; x++, src += 4, dst += 3 )
+			{
+				dst[0] = src[2];
+				dst[1] = src[1];
+				dst[2] = src[0];
+			}
+		}
+		return;
+	}
+
+	// i420: the y plane, then u and v at half size each way (the band size is even, so a
+	// band owns whole chroma rows):
+	int cw = ( w + 1 ) / 2, ch = ( h + 1 ) / 2;
+	unsigned char *yPlane = v->out;
+	unsigned char *uPlane = yPlane + (size_t)w * h;
+	unsigned char *vPlane = uPlane + (size_t)cw * ch;
+	for( int y = y0; y < y1; y++ )
+	{
+		const unsigned char *src = job->bgra + (size_t)( h - 1 - y ) * w * 4;
+		unsigned char *dst = yPlane + (size_t)y * w;
+		for( int x = 0; x < w; x++, src += 4 )
+			dst[x] = (unsigned char)( ( 66 * src[2] + 129 * src[1] + 25 * src[0] + 128 ) / 256 + 16 );
+	}
+	for( int cy = y0 / 2; cy < ( y1 + 1 ) / 2; cy++ )
+	{
+		const unsigned char *row0 = job->bgra + (size_t)( h - 1 - 2 * cy ) * w * 4;
+		const unsigned char *row1 = 2 * cy + 1 < h ? row0 - (size_t)w * 4 : row0;
+		for( int cx = 0; cx < cw; cx++ )
+		{
+			int x0 = 2 * cx, x1 = 2 * cx + 1 < w ? 2 * cx + 1 : 2 * cx;
+			int b = row0[4*x0+0] + row0[4*x1+0] + row1[4*x0+0] + row1[4*x1+0];
+			int g = row0[4*x0+1] + row0[4*x1+1] + row1[4*x0+1] + row1[4*x1+1];
+			int r = row0[4*x0+2] + row0[4*x1+2] + row1[4*x0+2] + row1[4*x1+2];
+			// >> rounds down where / would round negative sums toward zero, and bias u and v:
+			uPlane[(size_t)cy * cw + cx] = (unsigned char)( ( ( -38 * r - 74 * g + 112 * b + 512 ) >> 10 ) + 128 );
+			vPlane[(size_t)cy * cw + cx] = (unsigned char)( ( ( 112 * r - 94 * g - 18 * b + 512 ) >> 10 ) + 128 );
+		}
+	}
+}
+
+
+static void
+VideoWriterMain( struct VideoWriter *v )
+{
+	TRACE_THREAD_NAME( "video writer" );
+	JobsStart( &v->jobs, v->numThreads );
+	for( ; ; )
+	{
+		unsigned char *frame;
+		{
+			std::unique_lock<std::mutex> guard( v->lock );
+			v->changed.wait( guard, [v] { return ! v->full.empty( )  ||  v->finished; } );
+			if( v->full.empty( ) )
+				break;
+			frame = v->full.front( );
+			v->full.pop_front( );
+		}
+
+		TRACE_BEGIN( convertZone, "convert frame" );
+		struct VideoConvertJob job = { frame, v };
+		ParallelFor( &v->jobs, ( v->height + VIDEO_BAND_ROWS - 1 ) / VIDEO_BAND_ROWS, 1, VideoConvertRows, &job );
+		TRACE_END( convertZone );
+
+		TRACE_BEGIN( writeZone, "write frame" );
+		bool ok;
+		if( v->format == VIDEO_PPM )
+			ok = fprintf( v->fp, "P6\n%d %d\n255\n", v->width, v->height ) > 0;
+		else
+			ok = fputs( "FRAME\n", v->fp ) >= 0;
+		ok = ok  &&  fwrite( v->out, 1, v->outBytes, v->fp ) == v->outBytes;
+		TRACE_END( writeZone );
+
+		std::lock_guard<std::mutex> guard( v->lock );
+		v->free.push_back( frame );
+		v->framesWritten++;
+		if( ! ok )
+			v->failed = true;
+		v->changed.notify_all( );
+	}
+	JobsStop( &v->jobs );
+}
+
+
+// open filename ("-" for stdout) for width x height frames at fps, and start the writer,
+// converting on numThreads threads (0 for one per core):
+
+bool
+VideoOpen( const char *filename, int width, int height, int fps, int numThreads )
+{
+	struct VideoWriter *v = &Video;
+	const char *dot = strrchr( filename, '.' );
+	v->format = dot != NULL  &&  strcmp( dot, ".ppm" ) == 0 ? VIDEO_PPM : VIDEO_Y4M;
+	if( strcmp( filename, "-" ) == 0 )
+	{
+		v->fp = stdout;
+#ifdef WIN32
+		_setmode( _fileno( stdout ), _O_BINARY );
+#endif
+	}
+	else
+		v->fp = fopen( filename, "wb" );
+	if( v->fp == NULL )
+	{
+		fprintf( stderr, "Cannot write video to '%s'\n", filename );
+		return false;
+	}
+
+	v->width = width;
+	v->height = height;
+	v->fps = fps;
+	v->numThreads = numThreads;
+	if( v->format == VIDEO_PPM )
+		v->outBytes = (size_t)width * height * 3;
+	else
+	{
+		v->outBytes = (size_t)width * height + 2 * (size_t)( ( width + 1 ) / 2 ) * ( ( height + 1 ) / 2 );
+		fprintf( v->fp, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg XYSCSS=420JPEG XCOLORRANGE=LIMITED\n", width, height, fps );
+	}
+
+	size_t frameBytes = (size_t)width * height * 4;
+	v->out = new unsigned char[ v->outBytes ];
+	for( int b = 0; b < VIDEO_BUFFERS; b++ )
+		v->free.push_back( new unsigned char[ frameBytes ] );
+	MemAdd( MEM_SCRATCH, (long long)VIDEO_BUFFERS * frameBytes + (long long)v->outBytes );
+
+	v->usePbos = GLEW_ARB_pixel_buffer_object != 0;
+	if( v->usePbos )
+	{
+		glGenBuffers( VIDEO_PBOS, v->pbos );
+		for( int k = 0; k < VIDEO_PBOS; k++ )
+		{
+			glBindBuffer( GL_PIXEL_PACK_BUFFER, v->pbos[k] );
+			glBufferData( GL_PIXEL_PACK_BUFFER, frameBytes, NULL, GL_STREAM_READ );
+			v->pending[k] = false;
+		}
+		glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+		MemAdd( MEM_BUFFERS_GPU, (long long)VIDEO_PBOS * frameBytes );
+	}
+	else
+		fprintf( stderr, "No pixel buffer objects: video frames will be read back synchronously\n" );
+
+	v->next = 0;
+	v->mapWaitMS = v->stallMS = 0.;
+	v->framesCaptured = v->framesWritten = 0;
+	v->finished = v->failed = false;
+	v->thread = std::thread( VideoWriterMain, v );
+	return true;
+}
+
+
+// a free buffer to copy a frame into, waiting for the writer if there isn't one:
+
+static unsigned char *
+VideoGetBuffer( struct VideoWriter *v )
+{
+	std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now( );
+	std::unique_lock<std::mutex> guard( v->lock );
+	v->changed.wait( guard, [v] { return ! v->free.empty( ); } );
+	unsigned char *frame = v->free.back( );
+	v->free.pop_back( );
+	v->stallMS += std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now( ) - t0 ).count( );
+	return frame;
+}
+
+
+static void
+VideoSubmit( struct VideoWriter *v, unsigned char *frame )
+{
+	std::lock_guard<std::mutex> guard( v->lock );
+	v->full.push_back( frame );
+	v->changed.notify_all( );
+}
+
+
+// copy pbo k's frame out and hand it to the writer -- or, if it can't be mapped, drop it and
+// fail the video, rather than write whatever was in the buffer before:
+
+static void
+VideoCollect( struct VideoWriter *v, int k )
+{
+	unsigned char *frame = VideoGetBuffer( v );
+	std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now( );
+	glBindBuffer( GL_PIXEL_PACK_BUFFER, v->pbos[k] );
+	const void *pixels = glMapBuffer( GL_PIXEL_PACK_BUFFER, GL_READ_ONLY );
+	v->mapWaitMS += std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now( ) - t0 ).count( );
+	if( pixels != NULL )
+	{
+		memcpy( frame, pixels, (size_t)v->width * v->height * 4 );
+		glUnmapBuffer( GL_PIXEL_PACK_BUFFER );
+	}
+	glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+	v->pending[k] = false;
+	if( pixels != NULL )
+	{
+		VideoSubmit( v, frame );
+		return;
+	}
+
+	std::lock_guard<std::mutex> guard( v->lock );
+	if( ! v->failed )
+		fprintf( stderr, "Video: couldn't map a frame's pixel buffer (gl error 0x%x), so it was left out\n", glGetError( ) );
+	v->free.push_back( frame );
+	v->failed = true;
+	v->changed.notify_all( );
+}
+
+
+// queue the frame just drawn into target:
+
+void
+VideoCapture( const struct Offscreen *target )
+{
+	struct VideoWriter *v = &Video;
+	TRACE_ZONE( "video capture" );
+	glBindFramebuffer( GL_READ_FRAMEBUFFER, target->fbo );
+	glReadBuffer( GL_COLOR_ATTACHMENT0 );
+	glPixelStorei( GL_PACK_ALIGNMENT, 4 );
+
+	if( ! v->usePbos )
+	{
+		unsigned char *frame = VideoGetBuffer( v );
+		glReadPixels( 0, 0, v->width, v->height, GL_BGRA, GL_UNSIGNED_BYTE, frame );
+		VideoSubmit( v, frame );
+	}
+	else
+	{
+		int k = v->next;
+		if( v->pending[k] )
+			VideoCollect( v, k );		// VIDEO_PBOS frames old: the gpu should be long done with it
+		glBindBuffer( GL_PIXEL_PACK_BUFFER, v->pbos[k] );
+		glReadPixels( 0, 0, v->width, v->height, GL_BGRA, GL_UNSIGNED_BYTE, 0 );		// returns at once
+		glBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+		v->pending[k] = true;
+		v->next = ( k + 1 ) % VIDEO_PBOS;
+	}
+	glBindFramebuffer( GL_READ_FRAMEBUFFER, 0 );
+	v->framesCaptured++;
+}
+
+
+// collect the frames still in flight, wait for the writer to finish them, and close up:
+// returns false if anything failed to write
+
+bool
+VideoClose( )
+{
+	struct VideoWriter *v = &Video;
+	if( v->usePbos )
+	{
+		for( int i = 0; i < VIDEO_PBOS; i++ )
+		{
+			int k = ( v->next + i ) % VIDEO_PBOS;		// oldest first
+			if( v->pending[k] )
+				VideoCollect( v, k );
+		}
+	}
+	{
+		std::lock_guard<std::mutex> guard( v->lock );
+		v->finished = true;
+		v->changed.notify_all( );
+	}
+	v->thread.join( );
+
+	size_t frameBytes = (size_t)v->width * v->height * 4;
+	if( v->usePbos )
+	{
+		glDeleteBuffers( VIDEO_PBOS, v->pbos );
+		MemSub( MEM_BUFFERS_GPU, (long long)VIDEO_PBOS * frameBytes );
+	}
+	for( unsigned int b = 0; b < v->free.size( ); b++ )
+		delete [ ] v->free[b];
+	v->free.clear( );
+	delete [ ] v->out;
+	MemSub( MEM_SCRATCH, (long long)VIDEO_BUFFERS * frameBytes + (long long)v->outBytes );
+
+	bool ok = ! v->failed;
+	if( v->fp != stdout )
+		ok = fclose( v->fp ) == 0  &&  ok;
+	else
+		fflush( v->fp );
+	if( ! ok )
+		fprintf( stderr, "Writing the video failed\n" );
+	return ok;
+}